@@ -0,0 +1,461 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "bpromise/future.h"
+#include "bpromise/parallel.h"
+#include "bpromise/sockets.h"
+#include "bpromise/threadpool.h"
+
+// The benchmark suite: costs of the core primitives, then a loopback echo load
+// test reporting requests/s and latency percentiles for each reactor backend.
+//
+//   bpromise_bench [case...]    cases: ready chain repeat immediate timer pool parallel echo
+//
+// Without arguments every case runs. Run a Release build; compare the numbers
+// before and after a scheduler or socket change.
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr size_t iterations = 1000000;
+
+static volatile uint64_t sink;
+
+static void report(const char *name, double value, const char *unit)
+{
+    std::printf("%-36s %14.1f  %s\n", name, value, unit);
+}
+
+// p50/p99/p999 of the samples, in microseconds
+static void report_latency(const char *name, std::vector<double> &samples)
+{
+    if (samples.empty()) {
+        return;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    auto at = [&samples](double p) { return samples[static_cast<size_t>(p * (samples.size() - 1))]; };
+    std::printf("%-36s %14.1f  us p50 %10.1f  us p99 %10.1f  us p999\n", name, at(0.5), at(0.99), at(0.999));
+}
+
+template <typename F>
+static double ns_per(size_t count, F&& f)
+{
+    auto start = Clock::now();
+    // unsigned: the results only have to be consumed, wrapping is fine
+    uint64_t sum = 0;
+    for (size_t n = 0; n < count; ++n) {
+        sum += static_cast<uint64_t>(f(n));
+    }
+    sink = sum;
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / count;
+}
+
+// Runs f on MainThread, which stops once the future f returns resolves
+template <typename F>
+static void on_main(F f)
+{
+    BPromise::MainThread::set_immediate([&f]() {
+        f().then([]() {
+            BPromise::MainThread::stop();
+        });
+    });
+    BPromise::MainThread::run();
+}
+
+template <typename... T>
+static int value(BPromise::Future<T...> &future)
+{
+    return std::get<0>(future.state()->get());
+}
+
+static auto stage() { return [](int x) { return x + 1; }; }
+
+static void bench_ready()
+{
+    on_main([]() {
+        report("make_ready_future", ns_per(iterations, [](size_t n) {
+            auto future = BPromise::make_ready_future<int>(static_cast<int>(n));
+            return value(future);
+        }), "ns/future");
+
+        report("ready future then()", ns_per(iterations, [](size_t n) {
+            auto future = BPromise::make_ready_future<int>(static_cast<int>(n)).then(stage());
+            return value(future);
+        }), "ns/then");
+
+        return BPromise::make_ready_future<>();
+    });
+}
+
+static void bench_chain()
+{
+    on_main([]() {
+        report("then() chain of 5, ready", ns_per(iterations, [](size_t) {
+            auto future = BPromise::make_ready_future<int>(0).then(stage()).then(stage()).then(stage()).then(stage()).then(stage());
+            return value(future);
+        }), "ns/chain");
+
+        report("then() chain of 5, deferred", ns_per(iterations, [](size_t) {
+            BPromise::Promise<int> promise;
+            auto future = promise.get_future().then(stage()).then(stage()).then(stage()).then(stage()).then(stage());
+            promise.set_value(0);
+            return value(future);
+        }), "ns/chain");
+
+        report("then() fused 5 stages, deferred", ns_per(iterations, [](size_t) {
+            BPromise::Promise<int> promise;
+            auto future = promise.get_future().then(stage(), stage(), stage(), stage(), stage());
+            promise.set_value(0);
+            return value(future);
+        }), "ns/chain");
+
+        return BPromise::make_ready_future<>();
+    });
+}
+
+static void bench_repeat()
+{
+    for (bool ready : {true, false}) {
+        size_t n = 0;
+        Clock::time_point start;
+
+        on_main([&]() {
+            start = Clock::now();
+            return BPromise::repeat([&n, ready]() {
+                if (ready) {
+                    return BPromise::make_ready_future<bool>(++n < iterations);
+                }
+
+                // resolved on the next loop iteration
+                BPromise::Promise<bool> promise;
+                auto future = promise.get_future();
+                BPromise::MainThread::set_immediate([promise = std::move(promise), again = ++n < iterations]() mutable {
+                    promise.set_value(again);
+                });
+                return future;
+            });
+        });
+
+        auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        report(ready ? "repeat(), ready body" : "repeat(), deferred body", iterations / seconds, "iterations/s");
+    }
+}
+
+static void bench_immediate()
+{
+    // one task at a time, each posting the next
+    {
+        BPromise::Worker worker;
+        size_t left = iterations;
+        BPromise::UniqueFunction<void()> next;
+        next = [&]() {
+            if (--left == 0) {
+                worker.stop();
+                return;
+            }
+            worker.set_immediate([&next]() { next(); });
+        };
+
+        worker.set_immediate([&next]() { next(); });
+        auto start = Clock::now();
+        worker.run();
+        report("Worker::set_immediate, chained", iterations / std::chrono::duration<double>(Clock::now() - start).count(), "tasks/s");
+    }
+
+    // all posted up front
+    {
+        BPromise::Worker worker;
+        size_t done = 0;
+        auto start = Clock::now();
+        for (size_t n = 0; n < iterations; ++n) {
+            worker.set_immediate([&]() {
+                if (++done == iterations) {
+                    worker.stop();
+                }
+            });
+        }
+        worker.run();
+        report("Worker::set_immediate, burst", iterations / std::chrono::duration<double>(Clock::now() - start).count(), "tasks/s");
+    }
+}
+
+static void bench_timer()
+{
+    BPromise::Worker worker;
+    size_t done = 0;
+    auto start = Clock::now();
+
+    // spread over the first millisecond, so they fire in many batches
+    for (size_t n = 0; n < iterations; ++n) {
+        worker.set_timeout(std::chrono::microseconds(n % 1000), [&]() {
+            if (++done == iterations) {
+                worker.stop();
+            }
+        });
+    }
+    worker.run();
+
+    report("Worker timers set and fired", iterations / std::chrono::duration<double>(Clock::now() - start).count(), "timers/s");
+}
+
+// From set_immediate() on an outside thread until the task starts on the pool,
+// one task at a time: includes waking an idle pool thread
+static void bench_pool()
+{
+    static constexpr size_t samples_count = 20000;
+
+    BPromise::ThreadPool::start(4);
+
+    std::vector<double> samples;
+    samples.reserve(samples_count);
+    std::atomic<bool> ran{false};
+    double latency = 0;
+
+    for (size_t n = 0; n < samples_count; ++n) {
+        ran.store(false, std::memory_order_relaxed);
+        auto start = Clock::now();
+        BPromise::ThreadPool::set_immediate([start, &latency, &ran]() {
+            latency = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+            ran.store(true, std::memory_order_release);
+        });
+        while (!ran.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+        samples.push_back(latency);
+    }
+
+    BPromise::ThreadPool::stop();
+
+    report_latency("ThreadPool::set_immediate latency", samples);
+}
+
+// map_reduce over 100M elements with 1, 2, 4 ... hardware_concurrency pool
+// threads, against a plain loop on one thread
+static void bench_parallel()
+{
+    static constexpr size_t elements = 100000000;
+
+    std::vector<uint32_t> data(elements);
+    std::iota(data.begin(), data.end(), 0);
+
+    auto mapper = [](uint32_t x) { return static_cast<uint64_t>(x) * x; };
+    auto reducer = [](uint64_t a, uint64_t b) { return a + b; };
+
+    auto start = Clock::now();
+    uint64_t expected = 0;
+    for (auto x : data) {
+        expected = reducer(expected, mapper(x));
+    }
+    auto sequential = std::chrono::duration<double>(Clock::now() - start).count();
+    report("sequential reduction, 100M", elements / sequential, "elements/s");
+
+    auto cores = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned threads = 1;; threads = std::min(threads * 2, cores)) {
+        BPromise::ThreadPool::start(threads);
+
+        uint64_t result = 0;
+        double seconds = 0;
+        on_main([&]() {
+            start = Clock::now();
+            return BPromise::map_reduce(data, mapper, reducer, uint64_t(0)).then([&](uint64_t sum) {
+                seconds = std::chrono::duration<double>(Clock::now() - start).count();
+                result = sum;
+            });
+        });
+
+        BPromise::ThreadPool::stop();
+
+        auto label = "map_reduce, 100M, " + std::to_string(threads) + " threads";
+        report(label.c_str(), elements / seconds, "elements/s");
+        std::printf("%-36s %14.2f  x sequential%s\n", "", sequential / seconds, result == expected ? "" : "  WRONG RESULT");
+
+        if (threads == cores) {
+            break;
+        }
+    }
+}
+
+// Load generator of the echo case: `connections` sockets in lockstep, each
+// request timed from its send to the end of its reply
+static void echo_client(int port, size_t connections, Clock::time_point end, std::vector<double> &samples)
+{
+    static constexpr size_t message_size = 64;
+
+    std::vector<int> sockets;
+    for (size_t n = 0; n < connections; ++n) {
+        int s = ::socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        ::setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::connect(s, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            std::perror("connect");
+            std::exit(1);
+        }
+        sockets.push_back(s);
+    }
+
+    char message[message_size] = {'x'};
+    char reply[message_size];
+    std::vector<Clock::time_point> sent(connections);
+    while (Clock::now() < end) {
+        for (size_t n = 0; n < connections; ++n) {
+            sent[n] = Clock::now();
+            ::send(sockets[n], message, sizeof(message), 0);
+        }
+        for (size_t n = 0; n < connections; ++n) {
+            size_t received = 0;
+            while (received < sizeof(reply)) {
+                auto result = ::recv(sockets[n], reply + received, sizeof(reply) - received, 0);
+                if (result <= 0) {
+                    std::exit(1);
+                }
+                received += result;
+            }
+            samples.push_back(std::chrono::duration<double, std::micro>(Clock::now() - sent[n]).count());
+        }
+    }
+
+    for (auto s : sockets) {
+        ::close(s);
+    }
+}
+
+static void echo_run(BPromise::IoBackend backend, int port, size_t connections_per_client)
+{
+    static constexpr size_t client_threads = 4;
+    static constexpr auto duration = std::chrono::seconds(2);
+
+    const char *name = backend == BPromise::IoBackend::IoUring ? "io_uring" : "epoll";
+    if (BPromise::MainThread::set_io_backend(backend) != backend) {
+        std::printf("echo %-31s unavailable\n", name);
+        return;
+    }
+
+    auto server = std::make_unique<BPromise::ServerSocket>(port);
+    auto connections = client_threads * connections_per_client;
+    size_t closed = 0;
+    std::vector<std::vector<double>> samples(client_threads);
+    std::vector<std::thread> clients;
+    Clock::time_point start;
+
+    BPromise::MainThread::set_immediate([&]() {
+        BPromise::repeat([&]() {
+            return server->accept().then([&](BPromise::ConnectedSocket client) {
+                // the server socket was closed
+                if (!client.valid()) {
+                    return BPromise::make_ready_future<bool>(false);
+                }
+
+                BPromise::do_with(std::move(client), [&](BPromise::ConnectedSocket &client) {
+                    return BPromise::repeat([&client]() {
+                        return client.read_buffer().then([&client](int result, BPromise::TemporaryBuffer data) {
+                            if (result <= 0) {
+                                return BPromise::make_ready_future<bool>(false);
+                            }
+                            return client.send(std::move(data)).then([](int result) {
+                                return BPromise::make_ready_future<bool>(result > 0);
+                            });
+                        });
+                    }).then([&client]() {
+                        return client.close();
+                    }).then([&]() {
+                        if (++closed == connections) {
+                            server.reset();
+                            BPromise::MainThread::stop();
+                        }
+                    });
+                });
+                return BPromise::make_ready_future<bool>(true);
+            });
+        });
+
+        start = Clock::now();
+        for (size_t n = 0; n < client_threads; ++n) {
+            clients.emplace_back(echo_client, port, connections_per_client, start + duration, std::ref(samples[n]));
+        }
+    });
+
+    BPromise::MainThread::run();
+
+    for (auto& t : clients) {
+        t.join();
+    }
+    auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<double> all;
+    for (auto& s : samples) {
+        all.insert(all.end(), s.begin(), s.end());
+    }
+
+    std::string label = std::string("echo ") + name + ", " + std::to_string(connections) + " conns";
+    report(label.c_str(), all.size() / seconds, "requests/s");
+    report_latency(label.c_str(), all);
+}
+
+// The backend can only be switched while idle, so the epoll runs go first
+static void bench_echo()
+{
+    int port = 17900;
+    for (auto backend : {BPromise::IoBackend::Epoll, BPromise::IoBackend::IoUring}) {
+        for (size_t connections : {1, 16}) {
+            echo_run(backend, port++, connections);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct Case
+    {
+        const char *name;
+        void (*run)();
+    };
+
+    static const Case cases[] = {
+        {"ready", bench_ready},
+        {"chain", bench_chain},
+        {"repeat", bench_repeat},
+        {"immediate", bench_immediate},
+        {"timer", bench_timer},
+        {"pool", bench_pool},
+        {"parallel", bench_parallel},
+        {"echo", bench_echo},
+    };
+
+    std::vector<const Case*> selected;
+    for (int n = 1; n < argc; ++n) {
+        auto found = std::find_if(std::begin(cases), std::end(cases), [&](const Case &c) {
+            return std::strcmp(c.name, argv[n]) == 0;
+        });
+        if (found == std::end(cases)) {
+            std::fprintf(stderr, "unknown case %s\n", argv[n]);
+            return 1;
+        }
+        selected.push_back(found);
+    }
+    if (selected.empty()) {
+        for (auto& c : cases) {
+            selected.push_back(&c);
+        }
+    }
+
+    for (auto c : selected) {
+        std::fflush(stdout);
+        c->run();
+    }
+}
@@ -0,0 +1,65 @@
+#include <chrono>
+#include <cstdio>
+#include "bpromise/future.h"
+
+// Cost of a 5-stage continuation chain: on a ready future (runs inline), on a
+// deferred future with five then() calls, and with one fused then(a, b, c, d, e).
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr size_t iterations = 1000000;
+
+static auto stage() { return [](int x) { return x + 1; }; }
+
+template <typename F>
+static void measure(const char *name, F&& f)
+{
+    auto arena = BPromise::Arena::current();
+    auto before = arena->stats();
+    auto start = Clock::now();
+
+    int sum = 0;
+    for (size_t n = 0; n < iterations; ++n) {
+        sum += f();
+    }
+
+    auto ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+    auto stats = arena->stats();
+    auto blocks = double(stats.reused + stats.allocated - before.reused - before.allocated) / iterations;
+    std::printf("%-16s %10.1f %16.1f   (%d)\n", name, ns, blocks, sum);
+}
+
+static int result(BPromise::Future<int> &future)
+{
+    return std::get<0>(future.state()->get());
+}
+
+int main()
+{
+    BPromise::MainThread::set_immediate([]() {
+        std::printf("%-16s %10s %16s\n", "chain", "ns/chain", "arena blocks");
+
+        measure("ready", []() {
+            auto future = BPromise::make_ready_future<int>(0).then(stage()).then(stage()).then(stage()).then(stage()).then(stage());
+            return result(future);
+        });
+
+        measure("deferred", []() {
+            BPromise::Promise<int> promise;
+            auto future = promise.get_future().then(stage()).then(stage()).then(stage()).then(stage()).then(stage());
+            promise.set_value(0);
+            return result(future);
+        });
+
+        measure("deferred fused", []() {
+            BPromise::Promise<int> promise;
+            auto future = promise.get_future().then(stage(), stage(), stage(), stage(), stage());
+            promise.set_value(0);
+            return result(future);
+        });
+
+        BPromise::MainThread::stop();
+    });
+
+    BPromise::MainThread::run();
+}
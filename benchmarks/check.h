@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+// The *_check executables verify behaviour the benchmarks rely on (ordering,
+// counts, exactly-once delivery). A failed check prints its location and
+// aborts, so ctest reports it; exit() would run the static destructors, among
+// them MainThread's, which waits for the loop the check may be failing in.
+// Run them under the sanitizers as well.
+#define CHECK(condition)                                                                      \
+    do {                                                                                      \
+        if (!(condition)) {                                                                   \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            std::abort();                                                                     \
+        }                                                                                     \
+    } while (false)
@@ -0,0 +1,150 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "bpromise/future.h"
+#include "bpromise/sockets.h"
+
+// Echo server on MainThread, driven by blocking client threads that keep
+// `batch` connections each in lockstep (send on all of them, then read all replies).
+// Reports requests/s and the syscalls the server made per request with
+// each reactor backend. The backend can only be switched while idle, so all
+// epoll runs go first.
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr size_t client_threads = 4;
+static constexpr size_t message_size = 64;
+
+static void client(int port, size_t batch, size_t requests)
+{
+    std::vector<int> sockets;
+    for (size_t n = 0; n < batch; ++n) {
+        int s = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::connect(s, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            std::perror("connect");
+            std::exit(1);
+        }
+        sockets.push_back(s);
+    }
+
+    char message[message_size] = {'x'};
+    char reply[message_size];
+    for (size_t r = 0; r < requests; ++r) {
+        for (auto s : sockets) {
+            ::send(s, message, sizeof(message), 0);
+        }
+        for (auto s : sockets) {
+            size_t received = 0;
+            while (received < sizeof(reply)) {
+                auto result = ::recv(s, reply + received, sizeof(reply) - received, 0);
+                if (result <= 0) {
+                    std::exit(1);
+                }
+                received += result;
+            }
+        }
+    }
+
+    for (auto s : sockets) {
+        ::close(s);
+    }
+}
+
+template <typename F>
+static void serve(BPromise::ConnectedSocket client, F on_closed)
+{
+    BPromise::do_with(std::move(client), [on_closed](BPromise::ConnectedSocket &client) {
+        return BPromise::repeat([&client]() {
+            return client.read().then([&client](int result, std::string data) {
+                if (result <= 0) {
+                    return BPromise::make_ready_future<bool>(false);
+                }
+                return client.send(std::move(data)).then([](int result) {
+                    return BPromise::make_ready_future<bool>(result > 0);
+                });
+            });
+        }).then([&client]() {
+            return client.close();
+        }).then([on_closed]() {
+            on_closed();
+        });
+    });
+}
+
+static void run(BPromise::IoBackend backend, int port, size_t batch, size_t requests)
+{
+    auto used = BPromise::MainThread::set_io_backend(backend);
+    if (used != backend) {
+        std::printf("%-10s unavailable\n", "io_uring");
+        return;
+    }
+
+    auto& reactor = BPromise::MainThread::scheduler().reactor();
+    auto server = std::make_unique<BPromise::ServerSocket>(port);
+    auto connections = batch * client_threads;
+    size_t closed = 0;
+    Clock::time_point start;
+    BPromise::ReactorStats before;
+    std::vector<std::thread> clients;
+
+    BPromise::MainThread::set_immediate([&]() {
+        BPromise::repeat([&]() {
+            return server->accept().then([&](BPromise::ConnectedSocket client) {
+                // the server socket was closed
+                if (!client.valid()) {
+                    return BPromise::make_ready_future<bool>(false);
+                }
+
+                serve(std::move(client), [&]() {
+                    if (++closed == connections) {
+                        auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+                        auto stats = reactor.stats();
+                        double total = static_cast<double>(connections * requests);
+                        std::printf("%-10s %8zu %14.0f %14.3f %14.3f\n",
+                            backend == BPromise::IoBackend::IoUring ? "io_uring" : "epoll", connections,
+                            total / seconds, (stats.syscalls - before.syscalls) / total,
+                            (stats.completions - before.completions) / total);
+                        server.reset();
+                        BPromise::MainThread::stop();
+                    }
+                });
+                return BPromise::make_ready_future<bool>(true);
+            });
+        });
+
+        before = reactor.stats();
+        start = Clock::now();
+        for (size_t n = 0; n < client_threads; ++n) {
+            clients.emplace_back(client, port, batch, requests);
+        }
+    });
+
+    BPromise::MainThread::run();
+
+    for (auto& t : clients) {
+        t.join();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t requests = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 5000;
+    int port = 17000;
+
+    std::printf("%-10s %8s %14s %14s %14s\n", "backend", "conns", "requests/s", "syscalls/req", "cqes/req");
+    for (auto backend : {BPromise::IoBackend::Epoll, BPromise::IoBackend::IoUring}) {
+        for (size_t batch : {1, 8, 64}) {
+            run(backend, port++, batch, requests);
+        }
+    }
+}
@@ -0,0 +1,72 @@
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "bpromise/metrics.h"
+#include "bpromise/threadpool.h"
+#include "check.h"
+
+// MetricsEndpoint: answers a request, and can be destroyed while its accept
+// is pending, right after creation as well as after serving.
+
+using namespace BPromise;
+
+static constexpr int port = 47531;
+
+// Blocking HTTP GET from another thread, returns the whole response
+static std::string fetch()
+{
+    auto fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+
+    std::string request = "GET /metrics HTTP/1.0\r\n\r\n";
+    CHECK(::send(fd, request.data(), request.size(), 0) == static_cast<ssize_t>(request.size()));
+
+    std::string response;
+    char buffer[4096];
+    ssize_t size;
+    while ((size = ::recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        response.append(buffer, static_cast<size_t>(size));
+    }
+    ::close(fd);
+    return response;
+}
+
+int main()
+{
+    bool finished = false;
+    std::string response;
+    std::thread client;
+
+    MainThread::set_immediate([&]() {
+        // destroyed with the accept just started
+        delete new MetricsEndpoint(port);
+
+        auto endpoint = new MetricsEndpoint(port);
+        client = std::thread([&response]() { response = fetch(); });
+
+        MainThread::set_timeout(std::chrono::milliseconds(200), [&, endpoint]() {
+            // served, and waiting for the next connection again
+            delete endpoint;
+            MainThread::set_timeout(std::chrono::milliseconds(20), [&]() {
+                finished = true;
+                MainThread::stop();
+            });
+        });
+    });
+    MainThread::run();
+    client.join();
+
+    CHECK(finished);
+    CHECK(response.compare(0, 15, "HTTP/1.0 200 OK") == 0);
+    std::printf("metrics_check: served a request, destroyed with pending accepts\n");
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <numeric>
+#include <vector>
+#include "bpromise/parallel.h"
+#include "bpromise/threadpool.h"
+#include "check.h"
+
+// parallel_for_each, parallel_transform and map_reduce give the sequential
+// results, with pool threads and without (inline), for empty ranges as well.
+// map_reduce concatenating sequences also checks chunks are reduced in order.
+
+using namespace BPromise;
+
+static constexpr size_t element_count = 100000;
+
+// Runs the checks from a MainThread task; `done` counts the resolved futures
+static void run_checks(size_t &done)
+{
+    std::vector<uint64_t> numbers(element_count);
+    std::iota(numbers.begin(), numbers.end(), 1);
+    auto expected_sum = std::accumulate(numbers.begin(), numbers.end(), uint64_t(0), [](uint64_t sum, uint64_t n) {
+        return sum + n * 3;
+    });
+
+    auto shared = std::make_shared<std::vector<uint64_t>>(numbers);
+    map_reduce(*shared, [](uint64_t n) { return n * 3; }, [](uint64_t a, uint64_t b) { return a + b; }, uint64_t(0))
+        .then([&done, shared, expected_sum](uint64_t sum) {
+            CHECK(sum == expected_sum);
+            ++done;
+        });
+
+    // not commutative: wrong if chunks were combined out of order
+    using Sequence = std::vector<uint64_t>;
+    map_reduce(*shared, [](uint64_t n) { return Sequence{n}; },
+        [](Sequence a, Sequence b) {
+            a.insert(a.end(), b.begin(), b.end());
+            return a;
+        }, Sequence(), 1000)
+        .then([&done, shared](Sequence sequence) {
+            CHECK(sequence == *shared);
+            ++done;
+        });
+
+    // in place: out == begin
+    auto squares = std::make_shared<std::vector<uint64_t>>(numbers);
+    parallel_transform(squares->begin(), squares->end(), squares->begin(), [](uint64_t n) { return n * n; })
+        .then([&done, squares]() {
+            for (size_t n = 0; n < squares->size(); ++n) {
+                CHECK((*squares)[n] == (n + 1) * (n + 1));
+            }
+            ++done;
+        });
+
+    auto counts = std::make_shared<std::vector<std::atomic<int>>>(element_count);
+    parallel_for_each(counts->begin(), counts->end(), [](std::atomic<int> &count) { count.fetch_add(1); }, 64)
+        .then([&done, counts]() {
+            for (auto& count : *counts) {
+                CHECK(count.load() == 1);
+            }
+            ++done;
+        });
+
+    auto empty = std::make_shared<std::vector<uint64_t>>();
+    map_reduce(*empty, [](uint64_t n) { return n; }, [](uint64_t a, uint64_t b) { return a + b; }, uint64_t(42))
+        .then([&done, empty](uint64_t sum) {
+            CHECK(sum == 42);
+            ++done;
+        });
+    parallel_transform(empty->begin(), empty->end(), empty->begin(), [](uint64_t n) { return n; })
+        .then([&done, empty]() { ++done; });
+    parallel_for_each(*empty, [](uint64_t) { CHECK(false); })
+        .then([&done, empty]() { ++done; });
+}
+
+static constexpr size_t check_count = 7;
+
+static void run_on_main(size_t pool_threads)
+{
+    if (pool_threads) {
+        ThreadPool::start(pool_threads);
+    }
+
+    size_t done = 0;
+    TimerId poll = 0;
+    MainThread::set_immediate([&done, &poll]() {
+        run_checks(done);
+
+        // inline without pool threads, otherwise the continuations come back here
+        poll = MainThread::set_interval(std::chrono::milliseconds(1), [&done, &poll]() {
+            if (done == check_count) {
+                MainThread::clear_timer(poll);
+                MainThread::stop();
+            }
+        });
+    });
+    MainThread::run();
+
+    if (pool_threads) {
+        ThreadPool::stop();
+    }
+    CHECK(done == check_count);
+}
+
+int main()
+{
+    run_on_main(0);
+    run_on_main(4);
+
+    std::printf("parallel_check: sequential results with and without pool threads, empty ranges included\n");
+    return 0;
+}
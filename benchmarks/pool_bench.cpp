@@ -0,0 +1,59 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include "bpromise/threadpool.h"
+
+// ThreadPool throughput in tasks/s at 1, 4, 16 and 64 threads:
+//  - fan-out: a root task spawns a binary tree of tasks from inside the pool
+//    (local pushes, spread by stealing)
+//  - external: the main thread submits tasks one by one
+
+using Clock = std::chrono::steady_clock;
+
+static std::atomic<size_t> done{0};
+
+static void spawn(unsigned depth)
+{
+    if (depth > 0) {
+        BPromise::ThreadPool::set_immediate([depth]() { spawn(depth - 1); });
+        BPromise::ThreadPool::set_immediate([depth]() { spawn(depth - 1); });
+    }
+    done.fetch_add(1, std::memory_order_relaxed);
+}
+
+static double wait_for(size_t total, Clock::time_point start)
+{
+    while (done.load(std::memory_order_relaxed) < total) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    return total / std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned depth = argc > 1 ? std::atoi(argv[1]) : 20;
+    size_t fan_out_tasks = (size_t(2) << depth) - 1;
+    size_t external_tasks = size_t(1) << depth;
+
+    std::printf("%8s %16s %16s\n", "threads", "fan-out tasks/s", "external tasks/s");
+    for (size_t threads : {1, 4, 16, 64}) {
+        BPromise::ThreadPool::start(threads);
+
+        done = 0;
+        auto start = Clock::now();
+        BPromise::ThreadPool::set_immediate([depth]() { spawn(depth); });
+        auto fan_out = wait_for(fan_out_tasks, start);
+
+        done = 0;
+        start = Clock::now();
+        for (size_t n = 0; n < external_tasks; ++n) {
+            BPromise::ThreadPool::set_immediate([]() { done.fetch_add(1, std::memory_order_relaxed); });
+        }
+        auto external = wait_for(external_tasks, start);
+
+        std::printf("%8zu %16.0f %16.0f\n", threads, fan_out, external);
+        BPromise::ThreadPool::stop();
+    }
+}
@@ -0,0 +1,76 @@
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "bpromise/queue.h"
+#include "check.h"
+
+// TaskQueue: with several threads pushing at once, the consumer gets every node
+// exactly once, and the nodes of each producer in the order it pushed them.
+
+using BPromise::QueueNode;
+using BPromise::TaskQueue;
+
+static constexpr size_t producer_count = 4;
+static constexpr size_t per_producer = 200000;
+
+struct Item : QueueNode
+{
+    size_t producer = 0;
+    size_t sequence = 0;
+    bool popped = false;
+};
+
+int main()
+{
+    // nodes are not copyable, hence the arrays
+    std::vector<std::unique_ptr<Item[]>> items;
+    for (size_t p = 0; p < producer_count; ++p) {
+        items.emplace_back(new Item[per_producer]);
+    }
+    TaskQueue queue;
+
+    std::vector<std::thread> producers;
+    for (size_t p = 0; p < producer_count; ++p) {
+        producers.emplace_back([&queue, &items, p]() {
+            for (size_t n = 0; n < per_producer; ++n) {
+                auto& item = items[p][n];
+                item.producer = p;
+                item.sequence = n;
+                queue.push(&item);
+            }
+        });
+    }
+
+    // pop() may come back empty while a push is still linking its node
+    std::vector<size_t> next(producer_count);
+    size_t popped = 0;
+    while (popped < producer_count * per_producer) {
+        auto node = queue.pop();
+        if (!node) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        auto item = static_cast<Item*>(node);
+        CHECK(!item->popped);
+        CHECK(item->sequence == next[item->producer]);
+        item->popped = true;
+        ++next[item->producer];
+        ++popped;
+    }
+
+    for (auto& producer : producers) {
+        producer.join();
+    }
+
+    CHECK(queue.pop() == nullptr);
+    CHECK(queue.empty());
+    for (auto count : next) {
+        CHECK(count == per_producer);
+    }
+
+    std::printf("queue_check: %zu producers, %zu nodes popped once each, in order per producer\n",
+        producer_count, popped);
+    return 0;
+}
@@ -0,0 +1,59 @@
+#include <chrono>
+#include <cstdio>
+#include "bpromise/future.h"
+
+// ns/iteration of a 10M-iteration repeat() loop:
+//  - deferred: the body resolves on the next loop iteration, continuation state
+//    from the Worker arena vs the global heap
+//  - ready: the body returns a ready future, resolved through the trampoline
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr size_t iterations = 10000000;
+
+static BPromise::Future<bool> next(size_t &n)
+{
+    BPromise::Promise<bool> promise;
+    auto future = promise.get_future();
+
+    BPromise::MainThread::set_immediate([promise = std::move(promise), again = ++n < iterations]() mutable {
+        promise.set_value(again);
+    });
+
+    return future;
+}
+
+template <typename F>
+static void run(const char *name, bool arena, F body)
+{
+    size_t n = 0;
+    Clock::time_point start;
+    BPromise::ArenaStats before;
+
+    BPromise::MainThread::set_immediate([&]() {
+        BPromise::Arena::current()->set_enabled(arena);
+        before = BPromise::Arena::current()->stats();
+        start = Clock::now();
+
+        BPromise::repeat([&n, &body]() { return body(n); }).then([&]() {
+            auto ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+            auto stats = BPromise::Arena::current()->stats();
+            std::printf("%-16s %12.1f %16llu %16llu\n", name, ns,
+                static_cast<unsigned long long>(stats.reused - before.reused),
+                static_cast<unsigned long long>(stats.allocated - before.allocated));
+            BPromise::MainThread::stop();
+        });
+    });
+
+    BPromise::MainThread::run();
+}
+
+int main()
+{
+    auto ready = [](size_t &n) { return BPromise::make_ready_future<bool>(++n < iterations); };
+
+    std::printf("%-16s %12s %16s %16s\n", "body", "ns/iter", "arena reused", "arena allocated");
+    run("deferred/global", false, next);
+    run("deferred/arena", true, next);
+    run("ready", true, ready);
+}
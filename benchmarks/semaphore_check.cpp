@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "bpromise/semaphore.h"
+#include "bpromise/threadpool.h"
+#include "check.h"
+
+// Semaphore: waiters are served in FIFO order (a small request does not
+// overtake a big one), and with_semaphore returns its units when the work
+// resolves, throws, or is dropped without resolving.
+
+using namespace BPromise;
+
+static void fifo()
+{
+    Semaphore semaphore(2);
+    std::vector<int> order;
+
+    CHECK(semaphore.wait(2).state()->ready());
+    semaphore.wait(2).then([&order]() { order.push_back(1); });
+    semaphore.wait(1).then([&order]() { order.push_back(2); });
+    CHECK(semaphore.waiters() == 2);
+    CHECK(!semaphore.try_wait(0));
+
+    // enough for the second waiter, but the first comes first
+    semaphore.signal(1);
+    CHECK(order.empty());
+
+    semaphore.signal(1);
+    CHECK(order == std::vector<int>({1}));
+    CHECK(semaphore.available() == 0);
+
+    semaphore.signal(2);
+    CHECK(order == std::vector<int>({1, 2}));
+    CHECK(semaphore.available() == 1);
+    CHECK(semaphore.waiters() == 0);
+}
+
+static void concurrency_limit()
+{
+    static constexpr size_t task_count = 6;
+
+    Semaphore semaphore(2);
+    std::vector<std::unique_ptr<Promise<int>>> running;
+    std::vector<size_t> started;
+    int sum = 0;
+
+    for (size_t n = 0; n < task_count; ++n) {
+        with_semaphore(semaphore, 1, [&running, &started, n]() {
+            started.push_back(n);
+            running.push_back(std::make_unique<Promise<int>>());
+            return running.back()->get_future();
+        }).then([&sum](int value) { sum += value; });
+    }
+
+    // two at a time, in call order
+    for (size_t done = 0; done < task_count; ++done) {
+        CHECK(started.size() == std::min(task_count, done + 2));
+        running[done]->set_value(static_cast<int>(done));
+    }
+
+    for (size_t n = 0; n < task_count; ++n) {
+        CHECK(started[n] == n);
+    }
+    CHECK(sum == 15);
+    CHECK(semaphore.available() == 2);
+}
+
+static void released_on_exception()
+{
+    Semaphore semaphore(1);
+
+    // the units are taken right away, the exception leaves with_semaphore
+    bool thrown = false;
+    try {
+        with_semaphore(semaphore, 1, []() -> int { throw std::runtime_error("work failed"); });
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    CHECK(semaphore.available() == 1);
+
+    // queued: it leaves the signal() that let it run
+    CHECK(semaphore.try_wait(1));
+    with_semaphore(semaphore, 1, []() -> int { throw std::runtime_error("work failed"); });
+    thrown = false;
+    try {
+        semaphore.signal(1);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    CHECK(semaphore.available() == 1);
+    CHECK(semaphore.waiters() == 0);
+}
+
+static void released_on_destruction()
+{
+    Semaphore semaphore(1);
+    auto promise = std::make_unique<Promise<>>();
+    bool resolved = false;
+
+    with_semaphore(semaphore, 1, [&promise]() { return promise->get_future(); }).then([&resolved]() {
+        resolved = true;
+    });
+    CHECK(semaphore.available() == 0);
+
+    // the work is abandoned: its continuation goes, and the units with it
+    promise.reset();
+    CHECK(!resolved);
+    CHECK(semaphore.available() == 1);
+}
+
+int main()
+{
+    // continuations resolve the way they do in an application, on a worker
+    bool finished = false;
+    MainThread::set_immediate([&finished]() {
+        fifo();
+        concurrency_limit();
+        released_on_exception();
+        released_on_destruction();
+        finished = true;
+        MainThread::stop();
+    });
+    MainThread::run();
+
+    CHECK(finished);
+    std::printf("semaphore_check: FIFO order kept, units returned on resolve, exception and destruction\n");
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "bpromise/shards.h"
+#include "bpromise/sockets.h"
+
+// Echo throughput with 1, 2, 4... shards, each listening on the same port
+// (SO_REUSEPORT) and serving its connections without touching the others.
+// Blocking client threads each drive `batch` connections in lockstep.
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr size_t client_threads = 8;
+static constexpr size_t batch = 16;
+static constexpr size_t message_size = 64;
+
+static thread_local std::unique_ptr<BPromise::ServerSocket> server;
+
+static void client(int port, size_t requests)
+{
+    std::vector<int> sockets;
+    for (size_t n = 0; n < batch; ++n) {
+        int s = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::connect(s, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            std::perror("connect");
+            std::exit(1);
+        }
+        sockets.push_back(s);
+    }
+
+    char message[message_size] = {'x'};
+    char reply[message_size];
+    for (size_t r = 0; r < requests; ++r) {
+        for (auto s : sockets) {
+            ::send(s, message, sizeof(message), 0);
+        }
+        for (auto s : sockets) {
+            size_t received = 0;
+            while (received < sizeof(reply)) {
+                auto result = ::recv(s, reply + received, sizeof(reply) - received, 0);
+                if (result <= 0) {
+                    std::exit(1);
+                }
+                received += result;
+            }
+        }
+    }
+
+    for (auto s : sockets) {
+        ::close(s);
+    }
+}
+
+static void listen(int port)
+{
+    server = std::make_unique<BPromise::ServerSocket>(port, true);
+
+    BPromise::repeat([]() {
+        return server->accept().then([](BPromise::ConnectedSocket client) {
+            // the server socket was closed
+            if (!client.valid()) {
+                return BPromise::make_ready_future<bool>(false);
+            }
+
+            BPromise::do_with(std::move(client), [](BPromise::ConnectedSocket &client) {
+                return BPromise::repeat([&client]() {
+                    return client.read().then([&client](int result, std::string data) {
+                        if (result <= 0) {
+                            return BPromise::make_ready_future<bool>(false);
+                        }
+                        return client.send(std::move(data)).then([](int result) {
+                            return BPromise::make_ready_future<bool>(result > 0);
+                        });
+                    });
+                }).then([&client]() {
+                    return client.close();
+                });
+            });
+            return BPromise::make_ready_future<bool>(true);
+        });
+    });
+}
+
+static void run(size_t shards, int port, size_t requests)
+{
+    BPromise::Shards::start(shards);
+
+    BPromise::MainThread::set_immediate([=]() {
+        BPromise::Shards::invoke_on_all([port]() { listen(port); }).then([=]() {
+            auto start = Clock::now();
+
+            std::vector<std::thread> clients;
+            for (size_t n = 0; n < client_threads; ++n) {
+                clients.emplace_back(client, port, requests);
+            }
+            for (auto& t : clients) {
+                t.join();
+            }
+
+            auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            std::printf("%8zu %8zu %14.0f\n", shards, client_threads * batch, client_threads * batch * requests / seconds);
+
+            return BPromise::Shards::invoke_on_all([]() { server.reset(); });
+        }).then([]() {
+            BPromise::MainThread::stop();
+        });
+    });
+
+    BPromise::MainThread::run();
+    BPromise::Shards::stop();
+}
+
+int main(int argc, char *argv[])
+{
+    size_t requests = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000;
+    size_t max_shards = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : std::max(1u, std::thread::hardware_concurrency());
+    int port = 18000;
+
+    std::printf("%8s %8s %14s\n", "shards", "conns", "requests/s");
+    for (size_t shards = 1; shards <= max_shards; shards *= 2) {
+        run(shards, port++, requests);
+    }
+}
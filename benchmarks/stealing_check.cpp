@@ -0,0 +1,89 @@
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "bpromise/queue.h"
+#include "check.h"
+
+// StealingDeque: while the owner pushes and pops and several threads steal,
+// every item is taken exactly once, including across ring growth.
+
+using BPromise::StealingDeque;
+
+static constexpr size_t item_count = 500000;
+static constexpr size_t stealer_count = 3;
+
+struct Item
+{
+    std::atomic<int> taken{0};
+};
+
+int main()
+{
+    std::unique_ptr<Item[]> items(new Item[item_count]);
+    // small, so it grows while thieves read from it
+    StealingDeque<Item> deque(4);
+    std::atomic<size_t> total{0};
+    std::atomic<bool> done{false};
+
+    auto take = [&total](Item *item) {
+        CHECK(item->taken.fetch_add(1) == 0);
+        total.fetch_add(1);
+    };
+
+    std::vector<size_t> stolen(stealer_count);
+    std::vector<std::thread> stealers;
+    for (size_t s = 0; s < stealer_count; ++s) {
+        stealers.emplace_back([&, s]() {
+            while (!done.load()) {
+                if (auto item = deque.steal()) {
+                    take(item);
+                    ++stolen[s];
+                }
+            }
+        });
+    }
+
+    // the owner keeps a few items back for itself
+    size_t popped = 0;
+    for (size_t n = 0; n < item_count; ++n) {
+        deque.push(&items[n]);
+        if (n % 3 == 0) {
+            if (auto item = deque.pop()) {
+                take(item);
+                ++popped;
+            }
+        }
+    }
+    while (auto item = deque.pop()) {
+        take(item);
+        ++popped;
+    }
+
+    // what the owner could not pop was won by a thief
+    while (total.load() < item_count) {
+        std::this_thread::yield();
+    }
+    done.store(true);
+    for (auto& stealer : stealers) {
+        stealer.join();
+    }
+
+    CHECK(deque.empty());
+    CHECK(deque.steal() == nullptr);
+    CHECK(total.load() == item_count);
+    for (size_t n = 0; n < item_count; ++n) {
+        CHECK(items[n].taken.load() == 1);
+    }
+
+    size_t stolen_total = 0;
+    for (auto count : stolen) {
+        stolen_total += count;
+    }
+    CHECK(popped + stolen_total == item_count);
+
+    std::printf("stealing_check: %zu items taken once each, %zu popped by the owner, %zu stolen\n",
+        item_count, popped, stolen_total);
+    return 0;
+}
@@ -0,0 +1,175 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "bpromise/stream.h"
+
+// A chatty protocol: every 1-byte request is answered with `messages` small
+// messages. The server writes them either with one ConnectedSocket::send()
+// each, or through an OutputStream flushed once per request.
+// Reports messages/s and the syscalls the server made per message.
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr size_t client_threads = 4;
+static constexpr size_t connections = 8; // per client thread
+static constexpr size_t messages = 16;
+static constexpr size_t message_size = 32;
+
+static void client(int port, size_t requests)
+{
+    std::vector<int> sockets;
+    for (size_t n = 0; n < connections; ++n) {
+        int s = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::connect(s, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            std::perror("connect");
+            std::exit(1);
+        }
+        sockets.push_back(s);
+    }
+
+    char reply[messages * message_size];
+    for (size_t r = 0; r < requests; ++r) {
+        for (auto s : sockets) {
+            ::send(s, "x", 1, 0);
+        }
+        for (auto s : sockets) {
+            size_t received = 0;
+            while (received < sizeof(reply)) {
+                auto result = ::recv(s, reply + received, sizeof(reply) - received, 0);
+                if (result <= 0) {
+                    std::exit(1);
+                }
+                received += result;
+            }
+        }
+    }
+
+    for (auto s : sockets) {
+        ::close(s);
+    }
+}
+
+struct Connection
+{
+    explicit Connection(BPromise::ConnectedSocket s) :
+        socket(std::move(s)),
+        output(socket)
+    {
+    }
+
+    BPromise::ConnectedSocket socket;
+    BPromise::OutputStream output;
+};
+
+static BPromise::Future<bool> reply(Connection &c, bool stream)
+{
+    static const std::string message(message_size, 'm');
+
+    if (!stream) {
+        for (size_t n = 1; n < messages; ++n) {
+            c.socket.send(message);
+        }
+        return c.socket.send(message).then([](int result) {
+            return BPromise::make_ready_future<bool>(result > 0);
+        });
+    }
+
+    for (size_t n = 0; n < messages; ++n) {
+        c.output.write(message);
+    }
+    return c.output.flush().then([](int result) {
+        return BPromise::make_ready_future<bool>(result > 0);
+    });
+}
+
+template <typename F>
+static void serve(BPromise::ConnectedSocket client, bool stream, F on_closed)
+{
+    BPromise::do_with(std::make_unique<Connection>(std::move(client)), [stream, on_closed](std::unique_ptr<Connection> &c) {
+        return BPromise::repeat([&c, stream]() {
+            return c->socket.read().then([&c, stream](int result, std::string) {
+                if (result <= 0) {
+                    return BPromise::make_ready_future<bool>(false);
+                }
+                return reply(*c, stream);
+            });
+        }).then([&c]() {
+            return c->socket.close();
+        }).then([on_closed]() {
+            on_closed();
+        });
+    });
+}
+
+static void run(BPromise::IoBackend backend, bool stream, int port, size_t requests)
+{
+    if (BPromise::MainThread::set_io_backend(backend) != backend) {
+        return;
+    }
+
+    auto& reactor = BPromise::MainThread::scheduler().reactor();
+    auto server = std::make_unique<BPromise::ServerSocket>(port);
+    size_t closed = 0;
+    Clock::time_point start;
+    BPromise::ReactorStats before;
+    std::vector<std::thread> clients;
+
+    BPromise::MainThread::set_immediate([&]() {
+        BPromise::repeat([&]() {
+            return server->accept().then([&](BPromise::ConnectedSocket client) {
+                // the server socket was closed
+                if (!client.valid()) {
+                    return BPromise::make_ready_future<bool>(false);
+                }
+
+                serve(std::move(client), stream, [&]() {
+                    if (++closed == client_threads * connections) {
+                        auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+                        double total = static_cast<double>(client_threads * connections * requests * messages);
+                        std::printf("%-10s %-8s %14.0f %14.3f\n",
+                            backend == BPromise::IoBackend::IoUring ? "io_uring" : "epoll", stream ? "stream" : "send",
+                            total / seconds, (reactor.stats().syscalls - before.syscalls) / total);
+                        server.reset();
+                        BPromise::MainThread::stop();
+                    }
+                });
+                return BPromise::make_ready_future<bool>(true);
+            });
+        });
+
+        before = reactor.stats();
+        start = Clock::now();
+        for (size_t n = 0; n < client_threads; ++n) {
+            clients.emplace_back(client, port, requests);
+        }
+    });
+
+    BPromise::MainThread::run();
+
+    for (auto& t : clients) {
+        t.join();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t requests = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200;
+    int port = 17500;
+
+    std::printf("%-10s %-8s %14s %14s\n", "backend", "writes", "messages/s", "syscalls/msg");
+    for (auto backend : {BPromise::IoBackend::Epoll, BPromise::IoBackend::IoUring}) {
+        for (bool stream : {false, true}) {
+            run(backend, stream, port++, requests);
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include "bpromise/worker.h"
+
+// Dispatch cost of Worker with a growing number of pending (far future) timers.
+// Expected: ns/task stays flat while the number of pending timers grows.
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr size_t dispatch_count = 200000;
+
+struct Chain
+{
+    BPromise::Worker &worker;
+    size_t left;
+    Clock::time_point start;
+    Clock::time_point end;
+
+    void next()
+    {
+        if (left-- == 0) {
+            end = Clock::now();
+            worker.stop();
+            return;
+        }
+        worker.set_immediate([this]() { next(); });
+    }
+};
+
+static void run(size_t pending)
+{
+    BPromise::Worker worker;
+
+    for (size_t n = 0; n < pending; ++n) {
+        worker.set_timeout(std::chrono::hours(1) + std::chrono::microseconds(n * 7919 % pending), []() {});
+    }
+
+    // insert + cancel round trip with all timers pending
+    auto cancel_start = Clock::now();
+    for (size_t n = 0; n < dispatch_count; ++n) {
+        auto id = worker.set_timeout(std::chrono::minutes(30), []() {});
+        worker.clear_timer(id);
+    }
+    auto cancel_ns = std::chrono::duration<double, std::nano>(Clock::now() - cancel_start).count() / dispatch_count;
+
+    auto before = worker.allocation_stats();
+    Chain chain{worker, dispatch_count, Clock::now(), {}};
+    worker.set_immediate([&chain]() { chain.next(); });
+
+    std::thread thread([&worker]() { worker.run(); });
+    thread.join();
+
+    auto dispatch_ns = std::chrono::duration<double, std::nano>(chain.end - chain.start).count() / dispatch_count;
+    auto allocated = worker.allocation_stats().allocated - before.allocated;
+    std::printf("%10zu %16.1f %20.1f %18llu\n", pending, dispatch_ns, cancel_ns, static_cast<unsigned long long>(allocated));
+}
+
+int main()
+{
+    std::printf("%10s %16s %20s %18s\n", "pending", "dispatch ns/task", "set+clear ns/timer", "dispatch heap allocs");
+    for (size_t pending : {10, 1000, 10000, 100000, 1000000}) {
+        run(pending);
+    }
+}
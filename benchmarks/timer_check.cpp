@@ -0,0 +1,71 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "bpromise/timers.h"
+#include "check.h"
+
+// TimerHeap: removing nodes from anywhere in the heap keeps the others popping
+// in deadline order, equal deadlines in insertion order.
+
+using BPromise::TimePoint;
+using BPromise::TimerHeap;
+using BPromise::TimerNode;
+
+static constexpr size_t node_count = 10000;
+
+struct Timer : TimerNode
+{
+    size_t id = 0;
+};
+
+int main()
+{
+    std::mt19937 random(42);
+    std::vector<Timer> timers(node_count);
+    TimerHeap heap;
+
+    // few distinct deadlines, so many are equal
+    auto base = TimePoint();
+    for (size_t n = 0; n < node_count; ++n) {
+        timers[n].id = n;
+        heap.push(&timers[n], base + std::chrono::milliseconds(random() % 100));
+        CHECK(timers[n].armed());
+    }
+    CHECK(heap.size() == node_count);
+
+    // every third one, which sits anywhere from the root to the leaves
+    std::vector<bool> removed(node_count);
+    for (size_t n = 0; n < node_count; n += 3) {
+        heap.remove(&timers[n]);
+        CHECK(!timers[n].armed());
+        removed[n] = true;
+    }
+
+    // removing twice is a no-op
+    heap.remove(&timers[0]);
+
+    std::vector<Timer*> expected;
+    for (auto& timer : timers) {
+        if (!removed[timer.id]) {
+            expected.push_back(&timer);
+        }
+    }
+    std::stable_sort(expected.begin(), expected.end(), [](const Timer *a, const Timer *b) {
+        return a->deadline() < b->deadline();
+    });
+    CHECK(heap.size() == expected.size());
+
+    for (auto timer : expected) {
+        CHECK(heap.top() == timer);
+        CHECK(heap.pop() == timer);
+        CHECK(!timer->armed());
+    }
+    CHECK(heap.empty());
+    CHECK(heap.pop() == nullptr);
+
+    std::printf("timer_check: %zu timers, %zu removed from the middle, popped in order\n",
+        node_count, node_count - expected.size());
+    return 0;
+}
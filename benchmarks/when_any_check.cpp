@@ -0,0 +1,138 @@
+#include <cstdio>
+#include <variant>
+#include <vector>
+#include "bpromise/future.h"
+#include "bpromise/threadpool.h"
+#include "check.h"
+
+// when_any resolves exactly once, with the first future to resolve: the
+// futures resolving after it (or ready along with it) do not resolve it again.
+
+using namespace BPromise;
+
+struct Counts
+{
+    size_t resolved = 0;
+    size_t index = 0;
+};
+
+static void variadic()
+{
+    Promise<int> first;
+    Promise<long> second;
+    Promise<int> third;
+    Counts counts;
+    long value = 0;
+
+    when_any(first.get_future(), second.get_future(), third.get_future()).then([&](size_t index, auto result) {
+        ++counts.resolved;
+        counts.index = index;
+        value = std::get<1>(result);
+    });
+    CHECK(counts.resolved == 0);
+
+    second.set_value(2L);
+    first.set_value(1);
+    third.set_value(3);
+    CHECK(counts.resolved == 1);
+    CHECK(counts.index == 1);
+    CHECK(value == 2);
+}
+
+static void ready()
+{
+    Counts counts;
+    when_any(make_ready_future<int>(5), make_ready_future<int>(7)).then([&](size_t index, auto result) {
+        ++counts.resolved;
+        counts.index = index;
+        CHECK(std::get<0>(result) == 5);
+    });
+    CHECK(counts.resolved == 1);
+    CHECK(counts.index == 0);
+}
+
+static void range()
+{
+    std::vector<Promise<int>> promises(8);
+    std::vector<Future<int>> futures;
+    for (auto& promise : promises) {
+        futures.push_back(promise.get_future());
+    }
+
+    Counts counts;
+    int value = 0;
+    when_any(futures.begin(), futures.end()).then([&](size_t index, int result) {
+        ++counts.resolved;
+        counts.index = index;
+        value = result;
+    });
+
+    // taken over, like the variadic form's arguments
+    for (auto& future : futures) {
+        CHECK(!future.deferred());
+    }
+
+    promises[5].set_value(50);
+    for (size_t n = 0; n < promises.size(); ++n) {
+        if (n != 5) {
+            promises[n].set_value(static_cast<int>(n) * 10);
+        }
+    }
+    CHECK(counts.resolved == 1);
+    CHECK(counts.index == 5);
+    CHECK(value == 50);
+}
+
+static void range_without_values()
+{
+    std::vector<Promise<>> promises(4);
+    std::vector<Future<>> futures;
+    for (auto& promise : promises) {
+        futures.push_back(promise.get_future());
+    }
+
+    Counts counts;
+    when_any(futures.begin(), futures.end()).then([&](size_t index) {
+        ++counts.resolved;
+        counts.index = index;
+    });
+
+    promises[2].set_value();
+    promises[0].set_value();
+    promises[3].set_value();
+    promises[1].set_value();
+    CHECK(counts.resolved == 1);
+    CHECK(counts.index == 2);
+}
+
+static void empty_range()
+{
+    std::vector<Future<int>> futures;
+    Counts counts;
+    when_any(futures.begin(), futures.end()).then([&](size_t index, int) {
+        ++counts.resolved;
+        counts.index = index;
+    });
+    CHECK(counts.resolved == 1);
+    CHECK(counts.index == static_cast<size_t>(-1));
+}
+
+int main()
+{
+    // continuations resolve the way they do in an application, on a worker
+    bool finished = false;
+    MainThread::set_immediate([&finished]() {
+        variadic();
+        ready();
+        range();
+        range_without_values();
+        empty_range();
+        finished = true;
+        MainThread::stop();
+    });
+    MainThread::run();
+
+    CHECK(finished);
+    std::printf("when_any_check: resolved once, with the first future, in every case\n");
+    return 0;
+}
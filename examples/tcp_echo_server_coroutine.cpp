@@ -0,0 +1,49 @@
+#include <iostream>
+#include <string>
+#include "bpromise/coroutine.h"
+#include "bpromise/threadpool.h"
+#include "bpromise/sockets.h"
+
+// tcp_echo_server written with coroutines: the client socket lives in the
+// handler's frame, one allocation per connection instead of one per continuation
+
+BPromise::Future<> serve(BPromise::ConnectedSocket client)
+{
+    std::cout << client.port() << ": <client connected>\n";
+
+    while (true) {
+        auto [result, data] = co_await client.read();
+        if (result <= 0) {
+            break;
+        }
+
+        std::cout << client.port() << ": " << data << "\n";
+        bool again = (data != "bye");
+        co_await client.send(std::move(data));
+        if (!again) {
+            break;
+        }
+    }
+
+    co_await client.close();
+    std::cout << client.port() << ": <client disconnected>\n";
+}
+
+BPromise::Future<> listen(int port)
+{
+    BPromise::ServerSocket server(port);
+    std::cout << "<listening for incoming connections...>\n";
+
+    while (true) {
+        serve(co_await server.accept());
+    }
+}
+
+int main()
+{
+    BPromise::ThreadPool::start(4);
+
+    listen(5555);
+
+    BPromise::MainThread::run();
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+
+namespace BPromise
+{
+
+struct ArenaStats
+{
+    uint64_t reused = 0;    // blocks served from the free-lists
+    uint64_t allocated = 0; // blocks taken from the global heap
+};
+
+// Size-class free-lists for continuation state (callables that do not fit
+// UniqueFunction's inline storage) and I/O buffers. Each Worker owns one and
+// installs it as the current arena of its thread while running; blocks freed
+// there are recycled for the next continuation or read instead of going back to
+// the global allocator.
+//
+// Blocks are always rounded up to their size class, so a block can be released
+// into any arena, or to the global heap, regardless of where it came from.
+class Arena
+{
+public:
+    static constexpr size_t min_block = 64;
+    static constexpr size_t class_count = 8; // 64, 128 ... 8192 bytes
+    static constexpr size_t max_cached = 1024; // per size class
+    static constexpr size_t max_cached_bytes = 1024 * 1024; // per size class, for the bigger ones
+
+    Arena() = default;
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Arena of the Worker running on the calling thread, nullptr outside of Worker::run()
+    static Arena* current() { return _current; }
+
+    static void* allocate(size_t size)
+    {
+        auto index = size_class(size);
+        if (index == class_count) {
+            return ::operator new(size);
+        }
+
+        auto arena = _current;
+        if (arena && arena->_enabled) {
+            if (auto block = arena->_free[index]) {
+                arena->_free[index] = block->next;
+                --arena->_cached[index];
+                bump(arena->_reused);
+                return block;
+            }
+            bump(arena->_allocated);
+        }
+        return ::operator new(min_block << index);
+    }
+
+    static void deallocate(void *ptr, size_t size)
+    {
+        auto index = size_class(size);
+        auto arena = _current;
+        if (index < class_count && arena && arena->_enabled && arena->_cached[index] < cache_limit(index)) {
+            arena->_free[index] = new (ptr) Block{arena->_free[index]};
+            ++arena->_cached[index];
+            return;
+        }
+        ::operator delete(ptr);
+    }
+
+    template <typename T>
+    struct Deleter
+    {
+        void operator()(T *ptr) const
+        {
+            ptr->~T();
+            deallocate(ptr, sizeof(T));
+        }
+    };
+
+    template <typename T>
+    using Ptr = std::unique_ptr<T, Deleter<T>>;
+
+    // Single object in an arena block, for state handed between threads
+    // (it can be freed on any of them)
+    template <typename T, typename... Args>
+    static Ptr<T> make(Args&&... args)
+    {
+        static_assert(alignof(T) <= alignof(std::max_align_t));
+        auto ptr = allocate(sizeof(T));
+        try {
+            return Ptr<T>(new (ptr) T(std::forward<Args>(args)...));
+        } catch (...) {
+            deallocate(ptr, sizeof(T));
+            throw;
+        }
+    }
+
+    // Disabled arenas pass every request through to the global allocator.
+    // Only call from the owning Worker thread, or before it runs.
+    void set_enabled(bool enabled);
+    bool enabled() const { return _enabled; }
+
+    ArenaStats stats() const;
+
+private:
+    friend class Worker;
+
+    struct Block
+    {
+        Block *next;
+    };
+
+    static size_t size_class(size_t size)
+    {
+        size_t index = 0;
+        while (index < class_count && (min_block << index) < size) {
+            ++index;
+        }
+        return index;
+    }
+
+    static constexpr size_t cache_limit(size_t index)
+    {
+        return std::min(max_cached, max_cached_bytes / (min_block << index));
+    }
+
+    static void bump(std::atomic<uint64_t> &counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    void release();
+
+private:
+    static inline thread_local Arena *_current = nullptr;
+
+    Block *_free[class_count] = {};
+    size_t _cached[class_count] = {};
+    bool _enabled = true;
+    std::atomic<uint64_t> _reused{0};
+    std::atomic<uint64_t> _allocated{0};
+};
+
+}
\ No newline at end of file
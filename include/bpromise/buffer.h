@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace BPromise
+{
+
+// Move-only view of reference-counted bytes. share() hands out further views of
+// the same storage, so received data can be sliced, queued and forwarded without
+// copying; the storage goes away with the last view. Storage comes from the
+// current Worker's Arena and may be released on any thread.
+class TemporaryBuffer
+{
+public:
+    TemporaryBuffer() = default;
+
+    // `size` uninitialized bytes
+    explicit TemporaryBuffer(size_t size);
+
+    // Copy of data
+    TemporaryBuffer(const char *data, size_t size);
+
+    // Takes over the string's memory instead of copying it
+    explicit TemporaryBuffer(std::string data);
+
+    // `size` uninitialized bytes at an address aligned to `alignment` (a power
+    // of two), e.g. for O_DIRECT file I/O
+    static TemporaryBuffer aligned(size_t alignment, size_t size);
+
+    ~TemporaryBuffer() { release(); }
+
+    TemporaryBuffer(TemporaryBuffer&& other) noexcept :
+        _storage(other._storage),
+        _data(other._data),
+        _size(other._size)
+    {
+        other._storage = nullptr;
+        other._data = nullptr;
+        other._size = 0;
+    }
+
+    TemporaryBuffer& operator=(TemporaryBuffer&& other) noexcept
+    {
+        if (this != &other) {
+            release();
+            _storage = other._storage;
+            _data = other._data;
+            _size = other._size;
+            other._storage = nullptr;
+            other._data = nullptr;
+            other._size = 0;
+        }
+        return *this;
+    }
+
+    TemporaryBuffer(const TemporaryBuffer&) = delete;
+    TemporaryBuffer& operator=(const TemporaryBuffer&) = delete;
+
+    const char* get() const { return _data; }
+
+    // Writes show through every view sharing the storage
+    char* get_write() { return _data; }
+
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+    char operator[](size_t pos) const { return _data[pos]; }
+    std::string_view view() const { return std::string_view(_data, _size); }
+    std::string to_string() const { return std::string(_data, _size); }
+
+    TemporaryBuffer share() const { return share(0, _size); }
+
+    // View of `size` bytes starting at pos
+    TemporaryBuffer share(size_t pos, size_t size) const
+    {
+        if (_storage) {
+            _storage->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        return TemporaryBuffer(_storage, _data + pos, size);
+    }
+
+    // Keeps the first `size` bytes
+    void trim(size_t size) { _size = size; }
+
+    // Drops the first `size` bytes
+    void trim_front(size_t size)
+    {
+        _data += size;
+        _size -= size;
+    }
+
+    // true if no other view shares the storage
+    bool unique() const { return !_storage || _storage->refs.load(std::memory_order_acquire) == 1; }
+
+private:
+    struct Storage
+    {
+        std::atomic<uint32_t> refs{1};
+        void (*destroy)(Storage *storage);
+    };
+
+    TemporaryBuffer(Storage *storage, char *data, size_t size) :
+        _storage(storage),
+        _data(data),
+        _size(size)
+    {
+    }
+
+    void release()
+    {
+        if (_storage && _storage->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            _storage->destroy(_storage);
+        }
+        _storage = nullptr;
+    }
+
+private:
+    Storage *_storage = nullptr;
+    char *_data = nullptr;
+    size_t _size = 0;
+};
+
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include "bpromise/future.h"
+
+// C++20 coroutines over Future: `co_await future` inside a coroutine, and any
+// function returning Future<T...> can be a coroutine (co_return the value).
+// Compiles to nothing before C++20, the library itself stays C++17.
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+#define BPROMISE_HAS_COROUTINES 1
+
+namespace BPromise
+{
+
+// Resumes coroutines whose awaited future resolved
+class CoroutineResume
+{
+public:
+    static void resume(std::coroutine_handle<> handle)
+    {
+        // a coroutine completing in its final suspend point: it hands over to
+        // the awaiting one once its frame is gone, without nesting
+        if (_transfer && !*_transfer) {
+            *_transfer = handle;
+            return;
+        }
+
+        if (InlineContinuations::available()) {
+            InlineContinuations::Guard guard;
+            handle.resume();
+            return;
+        }
+
+        InlineContinuations::defer([handle]() { handle.resume(); });
+    }
+
+private:
+    template <typename... T>
+    friend class CoroutinePromiseBase;
+
+    static inline thread_local std::coroutine_handle<> *_transfer = nullptr;
+};
+
+template <typename... T>
+class FutureAwaiter
+{
+public:
+    explicit FutureAwaiter(Future<T...> &&future) :
+        _future(std::move(future))
+    {
+    }
+
+    bool await_ready()
+    {
+        if (!_future.state()->ready()) {
+            return false;
+        }
+        _value = _future.state()->move();
+        return true;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        _future.state()->set_callback([this, handle](std::tuple<T...> value) {
+            _value = std::move(value);
+            CoroutineResume::resume(handle);
+        });
+    }
+
+    // void, the value, or a tuple of the values
+    auto await_resume()
+    {
+        if constexpr (sizeof...(T) == 1) {
+            return std::move(std::get<0>(_value));
+        } else if constexpr (sizeof...(T) > 1) {
+            return std::move(_value);
+        }
+    }
+
+private:
+    Future<T...> _future;
+    std::tuple<T...> _value;
+};
+
+template <typename... T>
+FutureAwaiter<T...> operator co_await(Future<T...> &&future)
+{
+    return FutureAwaiter<T...>(std::move(future));
+}
+
+// Coroutines start eagerly, like any function returning a future. Frames come
+// from the current Worker's Arena; the frame is freed as soon as the body
+// returns, and a coroutine awaiting this one is resumed from there by
+// symmetric transfer rather than from inside the returning one.
+template <typename... T>
+class CoroutinePromiseBase
+{
+public:
+    Future<T...> get_return_object() { return _promise.get_future(); }
+
+    std::suspend_never initial_suspend() noexcept { return {}; }
+
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept { return false; }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            std::coroutine_handle<> next;
+            auto previous = std::exchange(CoroutineResume::_transfer, &next);
+            auto& promise = handle.promise();
+            promise._promise.set_value(std::move(promise._value));
+            CoroutineResume::_transfer = previous;
+
+            handle.destroy();
+            return next ? next : std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    // futures carry no errors, an escaping exception is fatal like anywhere else in the loop
+    void unhandled_exception() { std::terminate(); }
+
+    static void* operator new(size_t size) { return Arena::allocate(size); }
+    static void operator delete(void *ptr, size_t size) { Arena::deallocate(ptr, size); }
+
+protected:
+    Promise<T...> _promise;
+    std::tuple<T...> _value;
+};
+
+template <typename... T>
+class CoroutinePromise : public CoroutinePromiseBase<T...>
+{
+public:
+    void return_value(std::tuple<T...> value) { this->_value = std::move(value); }
+};
+
+template <typename T>
+class CoroutinePromise<T> : public CoroutinePromiseBase<T>
+{
+public:
+    template <typename U = T>
+    void return_value(U&& value) { std::get<0>(this->_value) = std::forward<U>(value); }
+};
+
+template <>
+class CoroutinePromise<> : public CoroutinePromiseBase<>
+{
+public:
+    void return_void() {}
+};
+
+}
+
+template <typename... T, typename... Args>
+struct std::coroutine_traits<BPromise::Future<T...>, Args...>
+{
+    using promise_type = BPromise::CoroutinePromise<T...>;
+};
+
+#endif
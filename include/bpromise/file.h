@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include "bpromise/buffer.h"
+#include "bpromise/future.h"
+
+namespace BPromise
+{
+
+// File opened for positional reads and writes that don't block the scheduler.
+// With the IoUring backend the calling Worker's reactor submits them; otherwise
+// they run on the ThreadPool, as open() always does (see ThreadPool::start).
+// Results resolve on the calling thread.
+// Opened with O_DIRECT, positions, sizes and buffers must be aligned to
+// `alignment`: read() allocates aligned buffers, writes take allocate()'s.
+// Operations in flight keep the descriptor's number only: close the file
+// after they resolved.
+class AsyncFile
+{
+public:
+    static constexpr size_t alignment = 4096;
+
+    AsyncFile() = default;
+    ~AsyncFile();
+
+    AsyncFile(AsyncFile&& other);
+    AsyncFile& operator=(AsyncFile&& other);
+
+    // flags and mode as for open(2). Resolves with a closed file on failure,
+    // see error().
+    static BPromise::Future<AsyncFile> open(std::string path, int flags, int mode = 0644);
+
+    bool is_open() const { return _fd >= 0; }
+    int fd() const { return _fd; }
+
+    // errno of a failed open()
+    int error() const { return _error; }
+
+    // Buffer for writes, aligned if the file was opened with O_DIRECT
+    TemporaryBuffer allocate(size_t size) const;
+
+    // Resolves with the byte count (fewer than size at end of file, -1 on error)
+    // and the data
+    BPromise::Future<int, TemporaryBuffer> read(uint64_t pos, size_t size);
+
+    // Resolves with the written size, or -1 on error
+    BPromise::Future<int> write(uint64_t pos, TemporaryBuffer data);
+    BPromise::Future<int> write(uint64_t pos, std::string data);
+
+    // fsync(), or fdatasync() with data_only. Resolves with 0, or -1 on error.
+    BPromise::Future<int> fsync(bool data_only = false);
+
+    BPromise::Future<> close();
+
+private:
+    AsyncFile(int fd, bool direct);
+
+private:
+    int _fd = -1;
+    int _error = 0;
+    bool _direct = false;
+};
+
+// Reads a file from start to end in chunks of chunk_size, with up to `ahead`
+// reads in flight so the next chunks are on their way while one is processed.
+// The file must outlive the reader, and the reader its pending reads.
+class FileReader
+{
+public:
+    explicit FileReader(AsyncFile &file, uint64_t pos = 0, size_t chunk_size = 128 * 1024, size_t ahead = 4);
+
+    FileReader(const FileReader&) = delete;
+    FileReader& operator=(const FileReader&) = delete;
+
+    // Resolves with the next chunk as AsyncFile::read(); 0 once at the end
+    BPromise::Future<int, TemporaryBuffer> read();
+
+private:
+    AsyncFile &_file;
+    uint64_t _pos;
+    size_t _chunk_size;
+    size_t _ahead;
+    bool _end = false;
+    std::deque<BPromise::Future<int, TemporaryBuffer>> _reads;
+};
+
+}
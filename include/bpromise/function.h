@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "bpromise/arena.h"
+
+namespace BPromise
+{
+
+template <typename Signature, size_t InlineSize = 48>
+class UniqueFunction;
+
+// Move-only std::function replacement.
+// Callables up to InlineSize bytes (and nothrow movable) are stored in place,
+// bigger ones are moved to the current Worker's Arena (the heap outside of workers).
+// Unlike std::function it accepts move-only callables, so promises can be captured by move.
+template <typename R, typename... Args, size_t InlineSize>
+class UniqueFunction<R(Args...), InlineSize>
+{
+public:
+    UniqueFunction() = default;
+    UniqueFunction(std::nullptr_t) {}
+
+    template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, UniqueFunction>>>
+    UniqueFunction(F&& f)
+    {
+        using Callable = std::decay_t<F>;
+
+        if constexpr (fits_inline<Callable>()) {
+            new (&_storage) Callable(std::forward<F>(f));
+            _ops = &inline_ops<Callable>;
+        } else {
+            *reinterpret_cast<Callable**>(&_storage) = heap_new<Callable>(std::forward<F>(f));
+            _ops = &heap_ops<Callable>;
+        }
+    }
+
+    ~UniqueFunction() { reset(); }
+
+    // Inline callables are nothrow movable and heap ones move as a pointer
+    UniqueFunction(UniqueFunction&& other) noexcept { construct_move(std::move(other)); }
+
+    UniqueFunction& operator=(UniqueFunction&& other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            construct_move(std::move(other));
+        }
+        return *this;
+    }
+
+    UniqueFunction& operator=(std::nullptr_t)
+    {
+        reset();
+        return *this;
+    }
+
+    UniqueFunction(const UniqueFunction&) = delete;
+    UniqueFunction& operator=(const UniqueFunction&) = delete;
+
+    explicit operator bool() const { return _ops != nullptr; }
+
+    // true if the callable did not fit the inline storage
+    bool heap_allocated() const { return _ops && _ops->heap; }
+
+    // Address of the code calling the callable, its symbol names the callable's
+    // type; for diagnostics
+    const void* target_code() const { return _ops ? reinterpret_cast<const void*>(_ops->invoke) : nullptr; }
+
+    R operator()(Args... args) { return _ops->invoke(&_storage, std::forward<Args>(args)...); }
+
+    template <typename Callable>
+    static constexpr bool fits_inline()
+    {
+        return sizeof(Callable) <= InlineSize
+            && alignof(Callable) <= alignof(std::max_align_t)
+            && std::is_nothrow_move_constructible_v<Callable>;
+    }
+
+private:
+    struct Ops
+    {
+        R (*invoke)(void *storage, Args&&... args);
+        void (*move)(void *to, void *from);
+        void (*destroy)(void *storage);
+        bool heap;
+    };
+
+    template <typename Callable, typename F>
+    static Callable* heap_new(F&& f)
+    {
+        if constexpr (alignof(Callable) <= alignof(std::max_align_t)) {
+            auto ptr = Arena::allocate(sizeof(Callable));
+            try {
+                return new (ptr) Callable(std::forward<F>(f));
+            } catch (...) {
+                Arena::deallocate(ptr, sizeof(Callable));
+                throw;
+            }
+        } else {
+            return new Callable(std::forward<F>(f));
+        }
+    }
+
+    template <typename Callable>
+    static void heap_delete(Callable *callable)
+    {
+        if constexpr (alignof(Callable) <= alignof(std::max_align_t)) {
+            callable->~Callable();
+            Arena::deallocate(callable, sizeof(Callable));
+        } else {
+            delete callable;
+        }
+    }
+
+    template <typename Callable>
+    static constexpr Ops inline_ops = {
+        [](void *storage, Args&&... args) -> R {
+            return (*static_cast<Callable*>(storage))(std::forward<Args>(args)...);
+        },
+        [](void *to, void *from) {
+            new (to) Callable(std::move(*static_cast<Callable*>(from)));
+            static_cast<Callable*>(from)->~Callable();
+        },
+        [](void *storage) { static_cast<Callable*>(storage)->~Callable(); },
+        false
+    };
+
+    template <typename Callable>
+    static constexpr Ops heap_ops = {
+        [](void *storage, Args&&... args) -> R {
+            return (**static_cast<Callable**>(storage))(std::forward<Args>(args)...);
+        },
+        [](void *to, void *from) { *static_cast<Callable**>(to) = *static_cast<Callable**>(from); },
+        [](void *storage) { heap_delete(*static_cast<Callable**>(storage)); },
+        true
+    };
+
+    void reset()
+    {
+        if (_ops) {
+            _ops->destroy(&_storage);
+            _ops = nullptr;
+        }
+    }
+
+    void construct_move(UniqueFunction&& other) noexcept
+    {
+        if (other._ops) {
+            other._ops->move(&_storage, &other._storage);
+            _ops = other._ops;
+            other._ops = nullptr;
+        }
+    }
+
+private:
+    const Ops *_ops = nullptr;
+    std::aligned_storage_t<InlineSize < sizeof(void*) ? sizeof(void*) : InlineSize, alignof(std::max_align_t)> _storage;
+};
+
+}
\ No newline at end of file
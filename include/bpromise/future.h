@@ -1,9 +1,15 @@
 #pragma once
 
-#include <functional>
+#include <iterator>
+#include <memory>
+#include <tuple>
 #include <type_traits>
-#include <cassert>
+#include <utility>
+#include <variant>
+#include <vector>
+#include "bpromise/function.h"
 #include "bpromise/threadpool.h"
+#include "bpromise/trace.h"
 
 namespace BPromise
 {
@@ -19,16 +25,22 @@ template <typename... T>
 class State
 {
 public:
+    // Moving a promise or future moves its state; as long as the values move
+    // without throwing, so do they, and callables capturing them can be stored
+    // inline by UniqueFunction
+    static constexpr bool nothrow_move = std::is_nothrow_move_constructible_v<std::tuple<T...>>
+        && std::is_nothrow_move_assignable_v<std::tuple<T...>>;
+
     State() = default;
 
-    State(State&& x)
+    State(State&& x) noexcept(nothrow_move)
     {
         _ready = x._ready;
         _on_set_value = std::move(x._on_set_value);
         _value = std::move(x._value);
     }
 
-    State& operator=(State&& x)
+    State& operator=(State&& x) noexcept(nothrow_move)
     {
         if (this != &x) {
             _ready = x._ready;
@@ -48,8 +60,10 @@ public:
     {
         _ready = true;
         if (_on_set_value) {
+            BPROMISE_TRACE_SCOPE("future", "continuation");
             _on_set_value(std::tuple<T...>(std::move(a)...));
         } else {
+            BPROMISE_TRACE_INSTANT("future", "set");
             _value = std::tuple<T...>(std::move(a)...);
         }
     }
@@ -59,8 +73,10 @@ public:
     {
         _ready = true;
         if (_on_set_value) {
+            BPROMISE_TRACE_SCOPE("future", "continuation");
             _on_set_value(std::move(a));
         } else {
+            BPROMISE_TRACE_INSTANT("future", "set");
             _value = std::move(a);
         }
     }
@@ -69,6 +85,7 @@ public:
     void set_callback(F&& f)
     {
         if (_ready) {
+            BPROMISE_TRACE_SCOPE("future", "continuation");
             f(std::move(_value));
         } else {
             _on_set_value = std::move(f);
@@ -78,7 +95,7 @@ public:
 private:
     bool _ready = false;
     std::tuple<T...> _value;
-    std::function<void(std::tuple<T...> value)> _on_set_value;
+    UniqueFunction<void(std::tuple<T...> value)> _on_set_value;
 };
 
 
@@ -89,9 +106,9 @@ public:
     Promise() { _state = &_local_state; }
     ~Promise() { destroy(); }
 
-    Promise(Promise&& other) { construct_move(std::move(other)); }
+    Promise(Promise&& other) noexcept(State<T...>::nothrow_move) { construct_move(std::move(other)); }
 
-    Promise& operator=(Promise&& other)
+    Promise& operator=(Promise&& other) noexcept(State<T...>::nothrow_move)
     {
         if (this != &other) {
             destroy();
@@ -100,13 +117,8 @@ public:
         return *this;
     }
 
-    // copy constructors left only for std::function compatibility.
-    // https://stackoverflow.com/questions/25421346/how-to-create-an-stdfunction-from-a-move-capturing-lambda-expression
-    //
-    // TODO: use move only std::function analog
-    // https://stackoverflow.com/questions/30854070/return-values-for-active-objects/30854998#30854998
-    Promise(const Promise&) { assert(false); }
-    void operator=(const Promise&) { assert(false); }
+    Promise(const Promise&) = delete;
+    Promise& operator=(const Promise&) = delete;
 
     Future<T...> get_future() { return Future<T...>(this); }
 
@@ -157,6 +169,88 @@ Future<T...> make_ready_future(A&&... value)
 }
 
 
+// Continuations of ready futures run inline, up to max_depth nested levels.
+// Deeper continuations are parked on a per-thread trampoline and run by the
+// outermost inline frame once the stack has unwound, so loops over ready
+// futures neither overflow the stack nor go back through the scheduler.
+class InlineContinuations
+{
+public:
+    static constexpr unsigned max_depth = 128;
+
+    static bool available() { return _depth < max_depth; }
+
+    // Only valid while an inline frame is active, i.e. when available() is false
+    template <typename F>
+    static void defer(F&& f) { _deferred.emplace_back(std::move(f)); }
+
+    struct Guard
+    {
+        Guard() { ++_depth; }
+
+        ~Guard()
+        {
+            if (--_depth == 0 && !_deferred.empty()) {
+                drain();
+            }
+        }
+    };
+
+private:
+    static void drain()
+    {
+        ++_depth;
+        while (!_deferred.empty()) {
+            _draining.swap(_deferred);
+            for (auto& f : _draining) {
+                f();
+            }
+            _draining.clear();
+        }
+        --_depth;
+    }
+
+private:
+    static inline thread_local unsigned _depth = 0;
+    static inline thread_local std::vector<UniqueFunction<void(), 128>> _deferred;
+    static inline thread_local std::vector<UniqueFunction<void(), 128>> _draining;
+};
+
+
+template <typename T>
+struct IsFuture : std::false_type {};
+
+template <typename... T>
+struct IsFuture<Future<T...>> : std::true_type {};
+
+// Fuses continuation stages into one callable at compile time.
+// A stage returning a plain value (or void) feeds the next stage directly;
+// a stage returning a future hands the remaining stages to its then().
+// future.then(a, b, c, d, e) therefore costs one continuation instead of five.
+template <typename F>
+std::decay_t<F> fuse(F&& f)
+{
+    return std::move(f);
+}
+
+template <typename F, typename G, typename... Rest>
+auto fuse(F&& f, G&& g, Rest&&... rest)
+{
+    return [f = std::move(f), next = fuse(std::move(g), std::move(rest)...)](auto&&... args) mutable {
+        using Result = decltype(f(std::forward<decltype(args)>(args)...));
+
+        if constexpr (std::is_void_v<Result>) {
+            f(std::forward<decltype(args)>(args)...);
+            return next();
+        } else if constexpr (IsFuture<Result>::value) {
+            return f(std::forward<decltype(args)>(args)...).then(std::move(next));
+        } else {
+            return next(f(std::forward<decltype(args)>(args)...));
+        }
+    };
+}
+
+
 template <typename T>
 struct Futurize
 {
@@ -196,9 +290,9 @@ class Future
 public:
     ~Future() { destroy(); }
 
-    Future(Future&& other) { construct_move(std::move(other)); }
+    Future(Future&& other) noexcept(State<T...>::nothrow_move) { construct_move(std::move(other)); }
 
-    Future& operator=(Future&& other)
+    Future& operator=(Future&& other) noexcept(State<T...>::nothrow_move)
     {
         if (this != &other) {
             destroy();
@@ -213,28 +307,52 @@ public:
     template <typename F, typename Futurator = Futurize<std::result_of_t<F(T&&...)>>>
     typename Futurator::FutureType then(F&& f)
     {
+        if (state()->ready() && InlineContinuations::available()) {
+            InlineContinuations::Guard guard;
+            return Futurator::get_result(f, state()->move());
+        }
+
         typename Futurator::PromiseType promise;
         auto future = promise.get_future();
         
         auto cb = [f = std::move(f), promise = std::move(promise)](std::tuple<T...> value) mutable {
             auto result_future = Futurator::get_result(f, std::move(value));
-            if (result_future.deferred()) {
+            if (result_future.state()->ready()) {
+                promise.set_value(result_future.state()->move());
+            } else {
                 result_future.state()->set_callback([promise = std::move(promise)](auto nested_result) mutable {
-                    // long .then chains (loops) cause stack overflow
-                    // TODO: something better for loops recursion
-                    MainThread::set_immediate([promise = std::move(promise), result = std::move(nested_result)]() mutable {
-                        promise.set_value(result);
+                    if (InlineContinuations::available()) {
+                        InlineContinuations::Guard guard;
+                        promise.set_value(std::move(nested_result));
+                        return;
+                    }
+                    // resolving long nested chains inline would overflow the stack
+                    InlineContinuations::defer([promise = std::move(promise), result = std::move(nested_result)]() mutable {
+                        promise.set_value(std::move(result));
                     });
                 });
-            } else {
-                promise.set_value(result_future.state()->move());
             }
         };
-        state()->set_callback(std::move(cb));
+
+        if (state()->ready()) {
+            // inline budget exhausted, continue once the stack has unwound
+            InlineContinuations::defer([cb = std::move(cb), value = state()->move()]() mutable {
+                cb(std::move(value));
+            });
+        } else {
+            state()->set_callback(std::move(cb));
+        }
 
         return future;
     }
 
+    // f.then(a, b, c) runs a, b and c as one fused continuation, see fuse()
+    template <typename F, typename G, typename... Rest>
+    auto then(F&& f, G&& g, Rest&&... rest)
+    {
+        return then(fuse(std::move(f), std::move(g), std::move(rest)...));
+    }
+
 private:
     Future() = default;
 
@@ -290,9 +408,9 @@ Future<> sleep(std::chrono::duration<Rep, Period> duration)
     Promise<> promise;
     auto future = promise.get_future();
 
-    MainThread::set_timeout([promise = std::move(promise)]() mutable {
+    this_scheduler().set_timeout(duration, [promise = std::move(promise)]() mutable {
         promise.set_value();
-    }, duration);
+    });
 
     return future;
 }
@@ -329,11 +447,233 @@ void do_with(T obj, F&& f)
     f(*ptr).then([ptr]() { });
 }
 
+
+template <typename F>
+struct FutureTraits;
+
+template <typename... T>
+struct FutureTraits<Future<T...>>
+{
+    // A Future<T...>'s result as one value: T for a single one, else std::tuple<T...>
+    using ValueType = std::conditional_t<sizeof...(T) == 1, std::tuple_element_t<0, std::tuple<T..., void>>, std::tuple<T...>>;
+
+    static ValueType value(std::tuple<T...> &&values)
+    {
+        if constexpr (sizeof...(T) == 1) {
+            return std::move(std::get<0>(values));
+        } else {
+            return std::move(values);
+        }
+    }
+};
+
+template <typename Tuple>
+struct FutureOf;
+
+template <typename... T>
+struct FutureOf<std::tuple<T...>>
+{
+    using FutureType = Future<T...>;
+    using PromiseType = Promise<T...>;
+};
+
+// Both combinators take the futures by value and register one callback on each
+// future's state, all sharing one counter; nothing else is allocated per future.
+
+template <size_t I, typename Pending, typename Input>
+void when_all_one(const std::shared_ptr<Pending> &pending, Input &future)
+{
+    future.state()->set_callback([pending](auto values) {
+        std::get<I>(pending->values) = FutureTraits<Input>::value(std::move(values));
+        if (--pending->left == 0) {
+            std::apply([&pending](auto&... v) { pending->promise.set_value(std::move(v)...); }, pending->values);
+        }
+    });
+}
+
+template <typename Pending, size_t... I, typename... Inputs>
+void when_all_each(const std::shared_ptr<Pending> &pending, std::index_sequence<I...>, Inputs&... futures)
+{
+    (when_all_one<I>(pending, futures), ...);
+}
+
+// Resolves once all futures have, with one value per future (see FutureTraits),
+// so that when_all(a(), b()).then([](A a, B b) { ... }) waits for the slower one
+template <typename... Inputs, typename = std::enable_if_t<(IsFuture<Inputs>::value && ...)>>
+auto when_all(Inputs... futures)
+{
+    using Values = std::tuple<typename FutureTraits<Inputs>::ValueType...>;
+
+    struct Pending
+    {
+        size_t left = sizeof...(Inputs);
+        Values values;
+        typename FutureOf<Values>::PromiseType promise;
+    };
+
+    auto pending = std::make_shared<Pending>();
+    auto future = pending->promise.get_future();
+
+    if constexpr (sizeof...(Inputs) == 0) {
+        pending->promise.set_value();
+    } else {
+        when_all_each(pending, std::index_sequence_for<Inputs...>(), futures...);
+    }
+
+    return future;
+}
+
+// Same over a range of futures of one type, resolving with a vector of the
+// values in the range's order (or with nothing for Future<>). The futures are
+// moved out of the range.
+template <typename Iterator, typename = std::enable_if_t<!IsFuture<Iterator>::value>>
+auto when_all(Iterator begin, Iterator end)
+{
+    using Input = typename std::iterator_traits<Iterator>::value_type;
+    using Value = typename FutureTraits<Input>::ValueType;
+    static constexpr bool no_values = std::is_same_v<Input, Future<>>;
+
+    struct Pending
+    {
+        size_t left = 0;
+        std::vector<Value> values;
+        std::conditional_t<no_values, Promise<>, Promise<std::vector<Value>>> promise;
+
+        void resolve()
+        {
+            if constexpr (no_values) {
+                promise.set_value();
+            } else {
+                promise.set_value(std::move(values));
+            }
+        }
+    };
+
+    auto pending = std::make_shared<Pending>();
+    auto future = pending->promise.get_future();
+    pending->left = static_cast<size_t>(std::distance(begin, end));
+    if constexpr (!no_values) {
+        pending->values.resize(pending->left);
+    }
+
+    if (pending->left == 0) {
+        pending->resolve();
+        return future;
+    }
+
+    // the count is known up front, so ready futures can not resolve it early.
+    // Each future is moved out, as the variadic form takes them by value: the
+    // range is left with moved-from ones rather than consumed lookalikes.
+    size_t index = 0;
+    for (auto it = begin; it != end; ++it, ++index) {
+        auto input = std::move(*it);
+        input.state()->set_callback([pending, index](auto values) {
+            if constexpr (!no_values) {
+                pending->values[index] = FutureTraits<Input>::value(std::move(values));
+            }
+            if (--pending->left == 0) {
+                pending->resolve();
+            }
+        });
+    }
+
+    return future;
+}
+
+template <typename Container, typename = std::enable_if_t<!IsFuture<std::decay_t<Container>>::value>>
+auto when_all(Container &&futures) -> decltype(when_all(std::begin(futures), std::end(futures)))
+{
+    return when_all(std::begin(futures), std::end(futures));
+}
+
+template <size_t I, typename Pending, typename Input>
+void when_any_one(const std::shared_ptr<Pending> &pending, Input &future)
+{
+    future.state()->set_callback([pending](auto values) {
+        if (!pending->done) {
+            pending->done = true;
+            pending->promise.set_value(I, typename Pending::Variant(std::in_place_index<I>, FutureTraits<Input>::value(std::move(values))));
+        }
+    });
+}
+
+template <typename Pending, size_t... I, typename... Inputs>
+void when_any_each(const std::shared_ptr<Pending> &pending, std::index_sequence<I...>, Inputs&... futures)
+{
+    (when_any_one<I>(pending, futures), ...);
+}
+
+// Resolves with the index and value of the first future to resolve; the later
+// results are dropped. Futures already ready count in argument order.
+template <typename Input, typename... Inputs, typename = std::enable_if_t<IsFuture<Input>::value && (IsFuture<Inputs>::value && ...)>>
+auto when_any(Input future, Inputs... futures)
+{
+    struct Pending
+    {
+        using Variant = std::variant<typename FutureTraits<Input>::ValueType, typename FutureTraits<Inputs>::ValueType...>;
+
+        bool done = false;
+        Promise<size_t, Variant> promise;
+    };
+
+    auto pending = std::make_shared<Pending>();
+    auto result = pending->promise.get_future();
+    when_any_each(pending, std::index_sequence_for<Input, Inputs...>(), future, futures...);
+    return result;
+}
+
+// Same over a range of futures of one type, which are moved out of it:
+// resolves with the index and value of the first one (only the index for
+// Future<>), or with size_t(-1) and a default value for an empty range
+template <typename Iterator, typename = std::enable_if_t<!IsFuture<Iterator>::value>>
+auto when_any(Iterator begin, Iterator end)
+{
+    using Input = typename std::iterator_traits<Iterator>::value_type;
+    static constexpr bool no_values = std::is_same_v<Input, Future<>>;
+
+    struct Pending
+    {
+        bool done = false;
+        std::conditional_t<no_values, Promise<size_t>, Promise<size_t, typename FutureTraits<Input>::ValueType>> promise;
+    };
+
+    auto pending = std::make_shared<Pending>();
+    auto future = pending->promise.get_future();
+
+    if (begin == end) {
+        if constexpr (no_values) {
+            pending->promise.set_value(static_cast<size_t>(-1));
+        } else {
+            pending->promise.set_value(static_cast<size_t>(-1), typename FutureTraits<Input>::ValueType());
+        }
+        return future;
+    }
+
+    // moved out of the range, see when_all()
+    size_t index = 0;
+    for (auto it = begin; it != end; ++it, ++index) {
+        auto input = std::move(*it);
+        input.state()->set_callback([pending, index](auto values) {
+            if (pending->done) {
+                return;
+            }
+            pending->done = true;
+            if constexpr (no_values) {
+                pending->promise.set_value(index);
+            } else {
+                pending->promise.set_value(index, FutureTraits<Input>::value(std::move(values)));
+            }
+        });
+    }
+
+    return future;
+}
+
 template<typename T>
 template <typename F, typename... Args>
 typename Futurize<T>::FutureType Futurize<T>::get_result(F&& f, Args... args)
 {
-    return FutureType(std::apply(f, std::move(args)...));
+    return make_ready_future<T>(std::apply(f, std::move(args)...));
 }
 
 template <typename F, typename... Args>
@@ -350,6 +690,53 @@ typename Futurize<Future<A...>>::FutureType Futurize<Future<A...>>::get_result(F
     return std::apply(f, std::move(args)...);
 }
 
+template <typename F, typename Futurator>
+typename Futurator::FutureType ThreadPool::submit(F&& f)
+{
+    auto promise = Arena::make<typename Futurator::PromiseType>();
+    auto future = promise->get_future();
+    offload<Futurator>(std::move(f), std::move(promise), nullptr);
+    return future;
+}
+
+template <typename F, typename Futurator>
+typename Futurator::FutureType ThreadPool::submit_bounded(size_t limit, F&& f)
+{
+    auto promise = Arena::make<typename Futurator::PromiseType>();
+    auto future = promise->get_future();
+    auto backlog = &_backlog;
+
+    if (backlog->running < limit) {
+        ++backlog->running;
+        offload<Futurator>(std::move(f), std::move(promise), backlog);
+    } else {
+        backlog->waiting.emplace_back([f = std::move(f), promise = std::move(promise), backlog]() mutable {
+            offload<Futurator>(std::move(f), std::move(promise), backlog);
+        });
+    }
+
+    return future;
+}
+
+// The promise lives in an arena block of the calling thread and only moves
+// as a pointer, so the future never sees the pool thread
+template <typename Futurator, typename F, typename PromisePtr>
+void ThreadPool::offload(F&& f, PromisePtr promise, Backlog *backlog)
+{
+    auto& origin = this_scheduler();
+
+    set_immediate([f = std::move(f), promise = std::move(promise), backlog, &origin]() mutable {
+        Futurator::get_result(f, std::tuple<>()).then([promise = std::move(promise), backlog, &origin](auto&&... values) mutable {
+            origin.set_immediate([promise = std::move(promise), backlog, values = std::make_tuple(std::move(values)...)]() mutable {
+                if (backlog) {
+                    release(backlog);
+                }
+                std::apply([&promise](auto&&... v) { promise->set_value(std::move(v)...); }, std::move(values));
+            });
+        });
+    });
+}
+
 
 
 }
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "bpromise/sockets.h"
+#include "bpromise/worker.h"
+
+namespace BPromise
+{
+
+// Prometheus text format (version 0.0.4) of worker metrics, labelled
+// worker="<name>". Durations are exported in seconds.
+std::string format_prometheus(const std::vector<std::pair<std::string, WorkerMetrics>> &workers);
+
+// MainThread's metrics as worker="main" and ThreadPool's as worker="pool-N"
+std::string prometheus_metrics();
+
+// Answers every HTTP request on the port with prometheus_metrics(), for a
+// scraper on the same host. Runs on the Worker that created it until destroyed.
+class MetricsEndpoint
+{
+public:
+    explicit MetricsEndpoint(int port);
+
+    MetricsEndpoint(const MetricsEndpoint&) = delete;
+    MetricsEndpoint& operator=(const MetricsEndpoint&) = delete;
+
+private:
+    std::unique_ptr<ServerSocket> _server;
+};
+
+}
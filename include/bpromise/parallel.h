@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "bpromise/future.h"
+
+namespace BPromise
+{
+
+// Data-parallel algorithms over random access ranges, run on ThreadPool.
+// The range is split into chunks, one pool task each: about chunks_per_thread
+// per pool thread, so that stealing evens out chunks of uneven cost, and none
+// smaller than `grain` elements (0: no minimum). Nothing is allocated per
+// element. The returned future resolves on the calling scheduler.
+//
+// The callables run concurrently on several pool threads, and the range must
+// stay alive until the future resolves. Without pool threads the whole range
+// runs inline and the future is ready.
+class ParallelChunks
+{
+public:
+    static constexpr size_t chunks_per_thread = 8;
+
+    static size_t count(size_t size, size_t grain)
+    {
+        auto threads = std::max<size_t>(ThreadPool::size(), 1);
+        auto chunks = std::min(size / std::max<size_t>(grain, 1), threads * chunks_per_thread);
+        return std::max<size_t>(chunks, 1);
+    }
+
+    // Calls job->run(chunk, from, to) for each chunk of [0, size) on the pool,
+    // then job->finish() on the calling scheduler, which then frees the job
+    template <typename Job>
+    static void run(std::unique_ptr<Job> job, size_t size, size_t chunks)
+    {
+        if (ThreadPool::size() == 0) {
+            for (size_t chunk = 0; chunk < chunks; ++chunk) {
+                job->run(chunk, size * chunk / chunks, size * (chunk + 1) / chunks);
+            }
+            job->finish();
+            return;
+        }
+
+        auto& origin = this_scheduler();
+        job->left.store(chunks, std::memory_order_relaxed);
+
+        // the last chunk to complete hands the job back to the caller's thread
+        auto shared = job.release();
+        for (size_t chunk = 0; chunk < chunks; ++chunk) {
+            ThreadPool::set_immediate([shared, chunk, from = size * chunk / chunks, to = size * (chunk + 1) / chunks, &origin]() {
+                shared->run(chunk, from, to);
+                if (shared->left.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    origin.set_immediate([shared]() {
+                        std::unique_ptr<Job> job(shared);
+                        job->finish();
+                    });
+                }
+            });
+        }
+    }
+};
+
+// Calls f(element) for every element of [begin, end)
+template <typename Iterator, typename F>
+Future<> parallel_for_each(Iterator begin, Iterator end, F f, size_t grain = 0)
+{
+    static_assert(std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<Iterator>::iterator_category>);
+
+    struct Job
+    {
+        Iterator begin;
+        F f;
+        std::atomic<size_t> left{0};
+        Promise<> promise{};
+
+        void run(size_t, size_t from, size_t to)
+        {
+            for (auto it = begin + from, last = begin + to; it != last; ++it) {
+                f(*it);
+            }
+        }
+
+        void finish() { promise.set_value(); }
+    };
+
+    auto size = static_cast<size_t>(end - begin);
+    auto job = std::unique_ptr<Job>(new Job{begin, std::move(f)});
+    auto future = job->promise.get_future();
+    ParallelChunks::run(std::move(job), size, ParallelChunks::count(size, grain));
+    return future;
+}
+
+template <typename Range, typename F, typename = decltype(std::begin(std::declval<Range&>()))>
+Future<> parallel_for_each(Range &range, F f, size_t grain = 0)
+{
+    return parallel_for_each(std::begin(range), std::end(range), std::move(f), grain);
+}
+
+// out[n] = f(begin[n]) for every element of [begin, end); out must have room
+// for them, and may be begin itself
+template <typename Iterator, typename OutputIterator, typename F>
+Future<> parallel_transform(Iterator begin, Iterator end, OutputIterator out, F f, size_t grain = 0)
+{
+    static_assert(std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<Iterator>::iterator_category>);
+    static_assert(std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<OutputIterator>::iterator_category>);
+
+    struct Job
+    {
+        Iterator begin;
+        OutputIterator out;
+        F f;
+        std::atomic<size_t> left{0};
+        Promise<> promise{};
+
+        void run(size_t, size_t from, size_t to)
+        {
+            auto target = out + from;
+            for (auto it = begin + from, last = begin + to; it != last; ++it, ++target) {
+                *target = f(*it);
+            }
+        }
+
+        void finish() { promise.set_value(); }
+    };
+
+    auto size = static_cast<size_t>(end - begin);
+    auto job = std::unique_ptr<Job>(new Job{begin, out, std::move(f)});
+    auto future = job->promise.get_future();
+    ParallelChunks::run(std::move(job), size, ParallelChunks::count(size, grain));
+    return future;
+}
+
+// reducer(...reducer(reducer(init, mapper(e0)), mapper(e1))..., mapper(eN)),
+// in any grouping: each chunk reduces its own elements, then the chunk results
+// are reduced into init in range order. The reducer must be associative.
+template <typename Iterator, typename Mapper, typename Reducer, typename T>
+Future<T> map_reduce(Iterator begin, Iterator end, Mapper mapper, Reducer reducer, T init, size_t grain = 0)
+{
+    static_assert(std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<Iterator>::iterator_category>);
+
+    struct Job
+    {
+        Iterator begin;
+        Mapper mapper;
+        Reducer reducer;
+        T init;
+        std::vector<std::optional<T>> partials;
+        std::atomic<size_t> left{0};
+        Promise<T> promise{};
+
+        void run(size_t chunk, size_t from, size_t to)
+        {
+            if (from == to) {
+                return;
+            }
+
+            auto it = begin + from;
+            auto last = begin + to;
+            T partial = mapper(*it);
+            for (++it; it != last; ++it) {
+                partial = reducer(std::move(partial), mapper(*it));
+            }
+            partials[chunk] = std::move(partial);
+        }
+
+        void finish()
+        {
+            auto result = std::move(init);
+            for (auto& partial : partials) {
+                if (partial) {
+                    result = reducer(std::move(result), std::move(*partial));
+                }
+            }
+            promise.set_value(std::move(result));
+        }
+    };
+
+    auto size = static_cast<size_t>(end - begin);
+    auto chunks = ParallelChunks::count(size, grain);
+    auto job = std::unique_ptr<Job>(new Job{begin, std::move(mapper), std::move(reducer), std::move(init), std::vector<std::optional<T>>(chunks)});
+    auto future = job->promise.get_future();
+    ParallelChunks::run(std::move(job), size, chunks);
+    return future;
+}
+
+template <typename Range, typename Mapper, typename Reducer, typename T, typename = decltype(std::begin(std::declval<Range&>()))>
+Future<T> map_reduce(Range &range, Mapper mapper, Reducer reducer, T init, size_t grain = 0)
+{
+    return map_reduce(std::begin(range), std::end(range), std::move(mapper), std::move(reducer), std::move(init), grain);
+}
+
+}
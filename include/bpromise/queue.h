@@ -0,0 +1,205 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace BPromise
+{
+
+class QueueNode
+{
+private:
+    friend class TaskQueue;
+
+    std::atomic<QueueNode*> _next{nullptr};
+};
+
+// Intrusive multi-producer single-consumer FIFO (Vyukov).
+// push is wait-free and may be called from any thread, pop only from the owning thread.
+// pop can return nullptr while a concurrent push is still linking its node; empty() stays false then.
+class TaskQueue
+{
+public:
+    TaskQueue() :
+        _head(&_stub),
+        _tail(&_stub)
+    {
+    }
+
+    TaskQueue(const TaskQueue&) = delete;
+    TaskQueue& operator=(const TaskQueue&) = delete;
+
+    bool empty() const { return _head.load() == &_stub; }
+
+    void push(QueueNode *node)
+    {
+        node->_next.store(nullptr, std::memory_order_relaxed);
+        auto prev = _head.exchange(node);
+        prev->_next.store(node, std::memory_order_release);
+    }
+
+    QueueNode* pop()
+    {
+        auto tail = _tail;
+        auto next = tail->_next.load(std::memory_order_acquire);
+
+        if (tail == &_stub) {
+            if (!next) {
+                return nullptr;
+            }
+            _tail = next;
+            tail = next;
+            next = next->_next.load(std::memory_order_acquire);
+        }
+
+        if (next) {
+            _tail = next;
+            return tail;
+        }
+
+        if (tail != _head.load()) {
+            return nullptr;
+        }
+
+        push(&_stub);
+        next = tail->_next.load(std::memory_order_acquire);
+        if (next) {
+            _tail = next;
+            return tail;
+        }
+
+        return nullptr;
+    }
+
+private:
+    std::atomic<QueueNode*> _head;
+    QueueNode *_tail;
+    QueueNode _stub;
+};
+
+// Chase-Lev work-stealing deque of pointers (Le et al., "Correct and Efficient
+// Work-Stealing for Weak Memory Models").
+// The owner pushes and pops at the bottom (LIFO), other threads steal from the
+// top (FIFO). The ring grows when full; replaced rings are kept until destruction
+// because a concurrent thief may still read from them.
+template <typename T>
+class StealingDeque
+{
+public:
+    explicit StealingDeque(size_t capacity = 256) :
+        _ring(new Ring(capacity))
+    {
+    }
+
+    ~StealingDeque()
+    {
+        delete _ring.load(std::memory_order_relaxed);
+        for (auto ring : _retired) {
+            delete ring;
+        }
+    }
+
+    StealingDeque(const StealingDeque&) = delete;
+    StealingDeque& operator=(const StealingDeque&) = delete;
+
+    bool empty() const
+    {
+        return _bottom.load(std::memory_order_relaxed) <= _top.load(std::memory_order_relaxed);
+    }
+
+    // Owner only
+    void push(T *item)
+    {
+        auto bottom = _bottom.load(std::memory_order_relaxed);
+        auto top = _top.load(std::memory_order_acquire);
+        auto ring = _ring.load(std::memory_order_relaxed);
+
+        if (bottom - top >= static_cast<int64_t>(ring->capacity)) {
+            ring = grow(ring, top, bottom);
+        }
+
+        ring->put(bottom, item);
+        _bottom.store(bottom + 1, std::memory_order_release);
+    }
+
+    // Owner only, nullptr if empty
+    T* pop()
+    {
+        auto bottom = _bottom.load(std::memory_order_relaxed) - 1;
+        auto ring = _ring.load(std::memory_order_relaxed);
+        _bottom.store(bottom, std::memory_order_seq_cst);
+        auto top = _top.load(std::memory_order_seq_cst);
+
+        if (top > bottom) {
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        auto item = ring->get(bottom);
+        if (top == bottom) {
+            // last item, race against thieves for it
+            if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                item = nullptr;
+            }
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // Any thread, nullptr if empty or another thread won the item
+    T* steal()
+    {
+        auto top = _top.load(std::memory_order_seq_cst);
+        auto bottom = _bottom.load(std::memory_order_seq_cst);
+
+        if (top >= bottom) {
+            return nullptr;
+        }
+
+        auto item = _ring.load(std::memory_order_acquire)->get(top);
+        if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return item;
+    }
+
+private:
+    struct Ring
+    {
+        explicit Ring(size_t capacity) :
+            capacity(capacity),
+            items(new std::atomic<T*>[capacity])
+        {
+        }
+
+        ~Ring() { delete[] items; }
+
+        T* get(int64_t index) const { return items[index & (capacity - 1)].load(std::memory_order_relaxed); }
+        void put(int64_t index, T *item) { items[index & (capacity - 1)].store(item, std::memory_order_relaxed); }
+
+        size_t capacity; // power of two
+        std::atomic<T*> *items;
+    };
+
+    Ring* grow(Ring *ring, int64_t top, int64_t bottom)
+    {
+        auto bigger = new Ring(ring->capacity * 2);
+        for (auto n = top; n < bottom; ++n) {
+            bigger->put(n, ring->get(n));
+        }
+
+        _retired.push_back(ring);
+        _ring.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+private:
+    alignas(64) std::atomic<int64_t> _top{0};
+    alignas(64) std::atomic<int64_t> _bottom{0};
+    std::atomic<Ring*> _ring;
+    std::vector<Ring*> _retired;
+};
+
+}
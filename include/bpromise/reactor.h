@@ -0,0 +1,273 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "bpromise/function.h"
+#include "bpromise/timers.h"
+
+#if defined(__linux__)
+#   define BPROMISE_HAS_EPOLL 1
+struct epoll_event;
+struct msghdr;
+#   if __has_include(<linux/io_uring.h>)
+#       define BPROMISE_HAS_IO_URING 1
+#   endif
+#endif
+
+namespace BPromise
+{
+
+class WaitEvent
+{
+public:
+    void signal();
+    void wait();
+    void wait_until(TimePoint time);
+
+private:
+    std::condition_variable _wait;
+    std::mutex _waitlock;
+    bool _stopwait = false;
+};
+
+class Reactor;
+
+enum class IoBackend
+{
+    Epoll,  // readiness based (a plain wait on platforms without epoll)
+    IoUring // completion based, Linux 5.13+
+};
+
+struct ReactorStats
+{
+    uint64_t syscalls = 0;    // issued by the reactor and the socket layer
+    uint64_t completions = 0; // io_uring completions reaped
+};
+
+// Target of io_uring requests. Multishot requests complete several times,
+// `more` is false on the last completion. `buffer` holds the received data of
+// a multishot recv, it is recycled once complete() returns.
+class IoCompletion
+{
+public:
+    virtual void complete(int result, bool more, const char *buffer) = 0;
+
+protected:
+    ~IoCompletion() = default;
+};
+
+class Uring;
+
+// Non-blocking descriptor registered on a Reactor (edge-triggered).
+// Operations try their syscall first and only park a waiter after EAGAIN;
+// waiters run on the reactor thread once the descriptor becomes ready again.
+// Not thread-safe: use it from the thread running the owning Worker.
+class PollableFd
+{
+public:
+    using Waiter = UniqueFunction<void()>;
+
+    // Tells callbacks whether the PollableFd they work on was destroyed meanwhile,
+    // e.g. because a continuation they resolved closed the socket. It compares
+    // the generation of the descriptor's slot in the Reactor, which outlives it.
+    class Guard
+    {
+    public:
+        explicit Guard(PollableFd &fd) :
+            _reactor(fd._reactor),
+            _slot(fd._slot),
+            _generation(fd._generation)
+        {
+        }
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+        bool alive() const;
+
+    private:
+        const Reactor &_reactor;
+        uint32_t _slot;
+        uint32_t _generation;
+    };
+
+    PollableFd(Reactor &reactor, int fd);
+
+    // Deregisters the descriptor (without closing it). Pending waiters
+    // still run once, with closed() returning true.
+    virtual ~PollableFd();
+
+    PollableFd(const PollableFd&) = delete;
+    PollableFd& operator=(const PollableFd&) = delete;
+
+    int fd() const { return _fd; }
+    bool closed() const { return _closed; }
+    Reactor& reactor() { return _reactor; }
+
+    void when_readable(Waiter waiter) { _readers.push_back(std::move(waiter)); }
+    void when_writable(Waiter waiter) { _writers.push_back(std::move(waiter)); }
+
+    // Runs the waiter after the next poll, ready or not: lets other work run
+    // between the steps of a long operation
+    void defer(Waiter waiter);
+
+    // Marks the descriptor closed and runs the pending waiters once, so they
+    // fail their operation. Derived classes call it before destroying
+    // themselves: their waiters use them, and would otherwise only run from
+    // this base's destructor, once the derived part is gone.
+    void fail_waiters();
+
+private:
+    friend class Reactor;
+
+    void notify(bool readable, bool writable);
+    void run(std::deque<Waiter> &waiters, Guard &guard);
+
+private:
+    Reactor &_reactor;
+    int _fd;
+    bool _closed = false;
+    uint32_t _slot = 0;
+    uint32_t _generation = 0;
+    std::deque<Waiter> _readers;
+    std::deque<Waiter> _writers;
+    std::deque<Waiter> _deferred;
+};
+
+// Wait primitive of a Worker.
+// On Linux it is an epoll instance plus an eventfd for cross-thread wakeups,
+// so a worker sleeping for its next timer also wakes up for socket readiness.
+// Elsewhere it falls back to a WaitEvent and cannot watch descriptors.
+//
+// With the io_uring backend requests are queued in the submission ring and
+// submitted together by the next wait(), which also reaps their completions;
+// the epoll instance is then watched through the ring itself.
+class Reactor
+{
+public:
+    Reactor();
+    ~Reactor();
+
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    // Selects the backend, call it before anything is registered or submitted.
+    // Returns the backend in use: Epoll if io_uring is not available.
+    IoBackend set_backend(IoBackend backend);
+    IoBackend backend() const { return _backend; }
+
+    // Number of registered descriptors and io_uring requests in flight
+    size_t size() const { return _size + _inflight; }
+
+    // Waits for descriptor readiness, a wake() or the deadline.
+    // TimePoint::max() waits without a timeout, TimePoint::min() only checks.
+    void wait(TimePoint deadline);
+
+    // Runs the waiters of descriptors found ready by the last wait()
+    void dispatch();
+
+    // Makes a concurrent or upcoming wait() return, callable from any thread
+    void wake();
+
+    ReactorStats stats() const;
+
+    // Accounts a syscall made on behalf of the reactor (e.g. by the socket layer)
+    void count_syscall() { bump(_syscalls); }
+
+    // Cancels the io_uring requests still in flight and reaps their completions,
+    // for at most drain_timeout, so their owners (e.g. sockets being closed)
+    // see them and free themselves. Called by the destructor, and by Worker's
+    // before it drops its queued tasks.
+    void drain();
+
+#if defined(BPROMISE_HAS_IO_URING)
+    // io_uring requests, only valid with the IoUring backend.
+    // The completion must stay alive until its last complete() call.
+    bool multishot() const { return _multishot; }
+    void disable_multishot() { _multishot = false; }
+
+    // Set by drain(): owners must not start new requests, only finish closing
+    bool stopping() const { return _stopping; }
+
+    void submit_accept(int fd, IoCompletion *completion);
+    void submit_recv(int fd, char *buffer, size_t size, IoCompletion *completion);
+    void submit_recv_multishot(int fd, IoCompletion *completion);
+    void submit_send(int fd, const char *data, size_t size, IoCompletion *completion);
+    // The message and its iovecs must stay alive until the completion
+    void submit_sendmsg(int fd, const msghdr *message, IoCompletion *completion);
+    void submit_close(int fd, IoCompletion *completion);
+    void submit_read(int fd, char *buffer, size_t size, uint64_t offset, IoCompletion *completion);
+    void submit_write(int fd, const char *data, size_t size, uint64_t offset, IoCompletion *completion);
+    void submit_fsync(int fd, bool data_only, IoCompletion *completion);
+    void submit_poll(int fd, unsigned events, IoCompletion *completion);
+    void submit_cancel(IoCompletion *completion);
+#endif
+
+private:
+    friend class PollableFd;
+    friend class PollableFd::Guard;
+
+    void add(PollableFd *fd);
+    void remove(PollableFd *fd);
+    void run_deferred();
+
+    // Gives the descriptor a slot and its current generation; releasing the
+    // slot bumps the generation, so the Guards of the descriptor see it gone
+    void acquire_slot(PollableFd *fd);
+    void release_slot(PollableFd *fd);
+
+#if defined(BPROMISE_HAS_EPOLL)
+    void poll_epoll(int timeout);
+    void dispatch_epoll();
+#endif
+
+#if defined(BPROMISE_HAS_IO_URING)
+    void watch_epoll();
+    void dispatch_uring();
+#endif
+
+    static void bump(std::atomic<uint64_t> &counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr int max_events = 256;
+    static constexpr auto drain_timeout = std::chrono::seconds(1);
+
+    IoBackend _backend = IoBackend::Epoll;
+    size_t _size = 0;
+    size_t _inflight = 0;
+    std::vector<PollableFd*> _deferred;  // descriptors with deferred waiters
+    std::vector<PollableFd*> _deferring; // the ones run_deferred() works on
+    std::vector<uint32_t> _generations;  // per descriptor slot, see PollableFd::Guard
+    std::vector<uint32_t> _free_slots;
+    std::atomic<uint64_t> _syscalls{0};
+    std::atomic<uint64_t> _completions{0};
+#if defined(BPROMISE_HAS_EPOLL)
+    int _epoll = -1;
+    int _wakeup = -1;
+    ::epoll_event *_events = nullptr;
+    int _ready = 0;
+#endif
+#if defined(BPROMISE_HAS_IO_URING)
+    std::unique_ptr<Uring> _uring;
+    bool _multishot = false;
+    bool _stopping = false;
+#endif
+#if !defined(BPROMISE_HAS_EPOLL)
+    WaitEvent _wait;
+#endif
+};
+
+inline bool PollableFd::Guard::alive() const
+{
+    return _reactor._generations[_slot] == _generation;
+}
+
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <utility>
+#include "bpromise/future.h"
+
+namespace BPromise
+{
+
+// Counting semaphore for the futures of one scheduler thread, to cap
+// concurrent connections or in-flight requests. wait(n) resolves once n units
+// are available; waiters are served in FIFO order, a later small request never
+// overtakes an earlier big one. Like the futures, it is not thread-safe and
+// takes no lock.
+//
+// Waiters still queued when the semaphore is destroyed never resolve.
+class Semaphore
+{
+public:
+    explicit Semaphore(size_t count) : _count(count) {}
+
+    Semaphore(const Semaphore&) = delete;
+    Semaphore& operator=(const Semaphore&) = delete;
+
+    Future<> wait(size_t units = 1);
+
+    // Takes the units only if that needs no waiting, to shed load instead of queueing it
+    bool try_wait(size_t units = 1);
+
+    // Returns units, resolving the waiters they satisfy
+    void signal(size_t units = 1);
+
+    size_t available() const { return _count; }
+    size_t waiters() const { return _waiters.size(); }
+
+private:
+    struct Waiter
+    {
+        size_t units;
+        Promise<> promise;
+    };
+
+    size_t _count;
+    std::deque<Waiter> _waiters;
+};
+
+// Units taken from a Semaphore, signalled back by release() or, at the latest,
+// by the destructor: work that throws or a continuation that is dropped
+// unresolved still returns them
+class SemaphoreUnits
+{
+public:
+    SemaphoreUnits(Semaphore &semaphore, size_t units) :
+        _semaphore(&semaphore),
+        _units(units)
+    {
+    }
+
+    ~SemaphoreUnits() { release(); }
+
+    SemaphoreUnits(SemaphoreUnits&& other) noexcept :
+        _semaphore(std::exchange(other._semaphore, nullptr)),
+        _units(other._units)
+    {
+    }
+
+    SemaphoreUnits& operator=(SemaphoreUnits&& other) noexcept
+    {
+        if (this != &other) {
+            release();
+            _semaphore = std::exchange(other._semaphore, nullptr);
+            _units = other._units;
+        }
+        return *this;
+    }
+
+    void release()
+    {
+        if (_semaphore) {
+            std::exchange(_semaphore, nullptr)->signal(_units);
+        }
+    }
+
+private:
+    Semaphore *_semaphore;
+    size_t _units;
+};
+
+// Runs f once `units` are taken from the semaphore and returns them when the
+// future f returns resolves; f may return a plain value, void or a future.
+// They are returned as well if f throws, or if its future is dropped without
+// resolving. The semaphore must outlive that future.
+template <typename F, typename Futurator = Futurize<std::result_of_t<F()>>>
+typename Futurator::FutureType with_semaphore(Semaphore &semaphore, size_t units, F&& f)
+{
+    return semaphore.wait(units).then([&semaphore, units, f = std::move(f)]() mutable {
+        SemaphoreUnits held(semaphore, units);
+        return Futurator::get_result(f, std::tuple<>()).then([held = std::move(held)](auto&&... values) mutable {
+            held.release();
+
+            typename Futurator::PromiseType promise;
+            auto future = promise.get_future();
+            promise.set_value(std::move(values)...);
+            return future;
+        });
+    });
+}
+
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include "bpromise/future.h"
+
+namespace BPromise
+{
+
+// Shard-per-core runtime: every shard is a thread running its own Worker
+// (reactor, timers, task pool and arena). Work started on a shard stays there:
+// sockets, timers and futures created on it are served and resolved by its
+// thread only, so shards share nothing and throughput scales with their count.
+// Shards talk to each other only through invoke_on(), which hands the result
+// back to the calling shard.
+class Shards
+{
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    // Starts `count` shards (one per hardware thread by default).
+    // With `pin` shard n is bound to CPU n modulo the CPU count, where supported.
+    static void start(size_t count = 0, IoBackend backend = IoBackend::Epoll, bool pin = true);
+    static void stop();
+
+    static size_t count() { return _shards.size(); }
+
+    // Index of the shard running on the calling thread, npos elsewhere
+    static size_t current() { return _current; }
+
+    static Worker& scheduler(size_t shard) { return _shards[shard]->scheduler; }
+
+    // Runs f on `shard` and resolves the returned future on the calling shard
+    // (or MainThread when called from outside of the shards) with f's result.
+    // f may return a plain value, void or a future, which is awaited on `shard`.
+    template <typename F, typename Futurator = Futurize<std::result_of_t<F()>>>
+    static typename Futurator::FutureType invoke_on(size_t shard, F&& f)
+    {
+        if (shard == _current) {
+            return Futurator::get_result(f, std::tuple<>());
+        }
+
+        // the promise stays on the heap so moving it around never touches
+        // the future, which belongs to the calling thread
+        using PromiseType = typename Futurator::PromiseType;
+        auto promise = std::make_unique<PromiseType>();
+        auto future = promise->get_future();
+        auto& origin = this_scheduler();
+
+        scheduler(shard).set_immediate([f = std::move(f), promise = std::move(promise), &origin]() mutable {
+            Futurator::get_result(f, std::tuple<>()).then([promise = std::move(promise), &origin](auto&&... values) mutable {
+                origin.set_immediate([promise = std::move(promise), values = std::make_tuple(std::move(values)...)]() mutable {
+                    std::apply([&promise](auto&&... v) { promise->set_value(std::move(v)...); }, std::move(values));
+                });
+            });
+        });
+
+        return future;
+    }
+
+    // Runs f on every shard; resolves once all of them are done
+    template <typename F>
+    static Future<> invoke_on_all(F f)
+    {
+        struct Pending
+        {
+            size_t left;
+            Promise<> promise;
+        };
+
+        auto pending = std::make_shared<Pending>();
+        pending->left = count();
+        auto future = pending->promise.get_future();
+
+        if (pending->left == 0) {
+            pending->promise.set_value();
+            return future;
+        }
+
+        for (size_t shard = 0; shard < count(); ++shard) {
+            invoke_on(shard, F(f)).then([pending](auto&&...) {
+                if (--pending->left == 0) {
+                    pending->promise.set_value();
+                }
+            });
+        }
+
+        return future;
+    }
+
+private:
+    struct Shard
+    {
+        Shard(size_t index, IoBackend backend, bool pin);
+
+        Scheduler scheduler;
+        std::thread thread;
+    };
+
+private:
+    static std::vector<std::unique_ptr<Shard>> _shards;
+    static inline thread_local size_t _current = npos;
+};
+
+}
@@ -9,56 +9,99 @@ namespace BPromise { using SOCKET = int; }
 #else
 #   error "unknown platform"
 #endif
+#include <memory>
 #include <string>
+#include <vector>
+#include "bpromise/buffer.h"
 #include "bpromise/future.h"
+#include "bpromise/reactor.h"
 
 namespace BPromise
 {
 
 class ServerSocket;
+struct SocketIo;
+struct ListenerIo;
 
+// Sockets belong to the Worker that created them (MainThread outside of
+// workers, see Shards for one per core): operations must be started from its
+// thread and resolve on it. On Linux its reactor serves them through epoll or
+// io_uring; elsewhere every operation blocks a ThreadPool thread, and sends
+// started together may then go out in any order (OutputStream keeps the order).
 class ConnectedSocket
 {
 public:
-    ConnectedSocket() = default;
+    ConnectedSocket();
     ~ConnectedSocket();
 
     ConnectedSocket(ConnectedSocket&& other);
     ConnectedSocket& operator=(ConnectedSocket&& other);
 
     int port() const { return _port; }
+
+    // false for a default-constructed or closed socket, and for the one a
+    // failed accept() resolves with
+    bool valid() const { return _socket != 0; }
+
+    // Resolves with the byte count (0 at end of stream, -1 on error) and the data
     BPromise::Future<int, std::string> read();
+
+    // Same as read(), but hands over the buffer the data was received into
+    BPromise::Future<int, TemporaryBuffer> read_buffer();
+
+    // Reads receive into buffers between min and max bytes: the size doubles
+    // after a read filled its buffer and halves after one used less than half of
+    // it. Pass min == max for a fixed size. Defaults to 1 KiB .. 64 KiB.
+    void set_read_size(size_t min, size_t max);
+
+    // Resolve once all of the data is sent (or with -1 on error). Sends are written
+    // in call order, and the data of queued ones goes out together in one sendmsg.
+    // The buffers of one call count as a single send.
     BPromise::Future<int> send(std::string data);
+    BPromise::Future<int> send(TemporaryBuffer data);
+    BPromise::Future<int> send(std::vector<TemporaryBuffer> buffers);
+
+    // Sends `length` bytes of the file from `offset`, in order with the other
+    // sends, and resolves with the bytes sent: fewer when the file is shorter or
+    // the socket failed. On Linux the kernel copies them with sendfile(), a slice
+    // at a time so the other sockets of the thread are served in between. The
+    // descriptor must stay open until then.
+    BPromise::Future<size_t> send_file(int fd, uint64_t offset, size_t length);
+
     BPromise::Future<> close();
 
 private:
     friend class ServerSocket;
+    friend struct ListenerIo;
 
-    ConnectedSocket(SOCKET socket, int port) :
-        _socket(socket),
-        _port(port)
-    {
-    }
+    ConnectedSocket(SOCKET socket, int port);
 
 private:
     SOCKET _socket = 0;
     int _port = 0;
-    std::mutex _mutex;
+    std::unique_ptr<SocketIo> _io;
 };
 
 class ServerSocket
 {
 public:
-    ServerSocket(int port);
+    // With reuse_port several sockets (e.g. one per shard) can listen on the same
+    // port and the kernel spreads incoming connections among them
+    ServerSocket(int port, bool reuse_port = false);
     ~ServerSocket();
 
     ServerSocket(ServerSocket&& other);
     ServerSocket& operator=(ServerSocket&& other);
 
+    // Resolves with an invalid socket if accepting failed or the server socket
+    // was closed meanwhile. On Linux running out of descriptors is not a
+    // failure: the accept is tried again a bit later, once some may have been
+    // released.
     BPromise::Future<ConnectedSocket> accept();
 
 private:
     SOCKET _socket = 0;
+    std::unique_ptr<ListenerIo> _io;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <deque>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "bpromise/buffer.h"
+#include "bpromise/sockets.h"
+
+namespace BPromise
+{
+
+// Buffers writes to a ConnectedSocket and sends them in batches: small writes are
+// copied into shared chunks, bigger buffers are queued as they are, and a batch
+// goes out as one gathered send once flush_size bytes are pending or on flush().
+// Only one batch is in flight at a time, so data is written in order on every
+// platform. The socket must outlive the stream, and the stream its pending
+// operations; unflushed data is dropped with the stream.
+class OutputStream
+{
+public:
+    static constexpr size_t chunk_size = 4096;
+    static constexpr size_t copy_threshold = 512; // writes up to this size are copied into a chunk
+
+    explicit OutputStream(ConnectedSocket &socket, size_t flush_size = 16 * 1024);
+
+    OutputStream(const OutputStream&) = delete;
+    OutputStream& operator=(const OutputStream&) = delete;
+
+    // Resolve with the written size, or -1 once a send failed. A write that brings
+    // the pending data to flush_size resolves when its batch is sent.
+    BPromise::Future<int> write(const char *data, size_t size);
+    BPromise::Future<int> write(std::string_view data) { return write(data.data(), data.size()); }
+    BPromise::Future<int> write(std::string data);
+    BPromise::Future<int> write(TemporaryBuffer data);
+
+    // Sends everything written so far; resolves with the size of the batch or -1
+    BPromise::Future<int> flush();
+
+    // Flushes, then closes the socket
+    BPromise::Future<> close();
+
+    size_t pending() const { return _pending_size; }
+    bool failed() const { return _failed; }
+
+private:
+    void seal_chunk();
+    BPromise::Future<int> buffered(size_t size);
+    void send_batch();
+
+private:
+    ConnectedSocket &_socket;
+    size_t _flush_size;
+
+    std::vector<TemporaryBuffer> _pending;
+    size_t _pending_size = 0;
+
+    // bytes [_chunk_start, _chunk_used) are written but not in _pending yet
+    TemporaryBuffer _chunk;
+    size_t _chunk_start = 0;
+    size_t _chunk_used = 0;
+
+    bool _sending = false;
+    bool _failed = false;
+    std::deque<Promise<int>> _flush_waiters; // of the next batch
+};
+
+// What a consume() parser did with the data it was offered
+struct Consumed
+{
+    size_t size; // bytes used, they are dropped from the stream
+    bool done;   // stop consuming
+};
+
+// Reads from a ConnectedSocket through a receive buffer and cuts the data into
+// messages. Results are views of the received buffers (see TemporaryBuffer), so
+// messages within one read are never copied; only a message spanning several
+// reads is joined into one buffer. A view keeps the whole receive buffer alive.
+// The socket must outlive the stream, and the stream its pending operations.
+class InputStream
+{
+public:
+    static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+    explicit InputStream(ConnectedSocket &socket);
+
+    InputStream(const InputStream&) = delete;
+    InputStream& operator=(const InputStream&) = delete;
+
+    // Resolves with the next `size` bytes; with fewer at end of stream
+    BPromise::Future<TemporaryBuffer> read_exactly(size_t size);
+
+    // Resolves with the data up to and including the delimiter. At end of stream
+    // it resolves with what is left, without delimiter (empty once nothing is).
+    BPromise::Future<TemporaryBuffer> read_until(std::string_view delimiter);
+
+    // Resolves with what is buffered, or with the next read; empty at end of stream
+    BPromise::Future<TemporaryBuffer> read_some();
+
+    // Offers the buffered and incoming data to parser, a Consumed(const TemporaryBuffer&)
+    // callable, until it is done. Bytes it leaves are offered again, followed by
+    // the next read's data. Resolves with true once done, false at end of stream.
+    template <typename Parser>
+    BPromise::Future<bool> consume(Parser parser)
+    {
+        while (!_buffer.empty()) {
+            auto result = parser(static_cast<const TemporaryBuffer&>(_buffer));
+            _buffer.trim_front(result.size);
+            if (result.done) {
+                return BPromise::make_ready_future<bool>(true);
+            }
+            if (result.size == 0) {
+                break;
+            }
+        }
+
+        if (_eof) {
+            return BPromise::make_ready_future<bool>(false);
+        }
+
+        return fill().then([this, parser = std::move(parser)](bool) mutable {
+            return consume(std::move(parser));
+        });
+    }
+
+    size_t buffered() const { return _buffer.size(); }
+
+    // The socket reached end of stream, or failed
+    bool eof() const { return _eof; }
+    bool failed() const { return _failed; }
+
+    // Position of delimiter in data, searching from `from`; npos if absent
+    static size_t find(std::string_view data, std::string_view delimiter, size_t from = 0);
+
+private:
+    // Appends the next read to the buffer; resolves with false at end of stream
+    BPromise::Future<bool> fill();
+    // Appends data to a non-empty buffer, in place while its block has room
+    void append(const TemporaryBuffer &data);
+    BPromise::Future<TemporaryBuffer> scan_until(std::string delimiter, size_t scanned);
+    BPromise::Future<TemporaryBuffer> read_into(TemporaryBuffer result, size_t filled);
+    TemporaryBuffer take(size_t size);
+    void end(int result);
+
+private:
+    ConnectedSocket &_socket;
+    TemporaryBuffer _buffer;
+    // Unused room of the block append() last grew, behind the buffer's views of
+    // it (which keep it alive); reset whenever a read replaces the buffer
+    char *_spare = nullptr;
+    size_t _spare_size = 0;
+    bool _eof = false;
+    bool _failed = false;
+};
+
+}
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
+#include <deque>
 #include <memory>
+#include <type_traits>
 #include <vector>
 #include <thread>
 #include "bpromise/worker.h"
@@ -11,6 +14,9 @@ namespace BPromise
 
 using Scheduler = BPromise::Worker;
 
+template <typename T>
+struct Futurize;
+
 class MainThread
 {
 public:
@@ -21,93 +27,131 @@ public:
     }
 
     template <typename F, typename Clock = std::chrono::steady_clock, typename Rep, typename Period>
-    static void set_timeout(std::chrono::duration<Rep, Period> interval, F&& f)
+    static TimerId set_timeout(std::chrono::duration<Rep, Period> interval, F&& f)
     {
-        _scheduler.set_timeout(std::move(f), interval);
+        return _scheduler.set_timeout(interval, std::move(f));
     }
 
     template <typename F, typename Clock = std::chrono::steady_clock, typename Rep, typename Period>
-    static void set_interval(std::chrono::duration<Rep, Period> interval, F&& f)
+    static TimerId set_interval(std::chrono::duration<Rep, Period> interval, F&& f)
     {
-        _scheduler.set_interval(std::move(f), interval);
+        return _scheduler.set_interval(interval, std::move(f));
     }
 
-    static void run() { _scheduler.run();}
+    static bool clear_timer(TimerId id) { return _scheduler.clear_timer(id); }
+
+    // Call before creating sockets on the main thread; returns the backend in use
+    static IoBackend set_io_backend(IoBackend backend) { return _scheduler.reactor().set_backend(backend); }
+
+    static void run()
+    {
+        BPROMISE_TRACE_THREAD("main");
+        _scheduler.run();
+    }
+    static void stop() { _scheduler.stop(); }
+    static Scheduler& scheduler() { return _scheduler; }
+    static WorkerMetrics metrics() { return _scheduler.metrics(); }
 
 private:
     static Scheduler _scheduler;
 };
 
+// Worker running on the calling thread, MainThread's outside of workers
+inline Scheduler& this_scheduler()
+{
+    auto worker = Worker::current();
+    return worker ? *worker : MainThread::scheduler();
+}
+
+// Work-stealing pool. Every thread runs a Worker (for timers and sockets) plus a
+// Chase-Lev deque: tasks submitted from a pool thread go to the bottom of its
+// own deque and run LIFO, while the cache is still warm; threads that run out
+// of work steal the oldest tasks of random victims. Submissions from outside
+// the pool go lock-free to the immediate queue of a round-robin picked thread.
 class ThreadPool
 {
 public:
+    static void start(size_t count, IoBackend backend = IoBackend::Epoll);
+    static void stop();
 
-    static void start(size_t count)
-    {
-        for (size_t n = 0; n < count; ++n) {
-            _threads.emplace_back(std::make_unique<Thread>());
-        }
-    }
+    static size_t size() { return _threads.size(); }
+
+    // One snapshot per thread, see Worker::metrics(). Call while the pool runs,
+    // not concurrently with start() or stop().
+    static std::vector<WorkerMetrics> metrics();
 
-    static void stop()
+    template <typename Func>
+    static void set_immediate(Func&& f)
     {
-        for (auto& t : _threads) {
-            t->scheduler.stop();
+        if (auto local = _local) {
+            auto task = local->scheduler.make_task(TaskType::Oneshot, std::chrono::milliseconds(0), std::move(f));
+            local->deque.push(task);
+            wake_idle(local);
+            return;
         }
 
-        for (auto& t : _threads) {
-            t->thread.join();
+        if (_threads.empty()) {
+            return;
         }
 
-        _threads.clear();
+        auto n = _next.fetch_add(1, std::memory_order_relaxed) % _threads.size();
+        _threads[n]->scheduler.set_immediate(std::move(f));
     }
 
-    template <typename Func>
-    static void set_immediate(Func&& f)
-    {
-        auto found = find_thread();
+    // Runs f on the pool and resolves the returned future with its result on the
+    // calling thread's scheduler. f may return a plain value, void or a future.
+    // Defined in future.h.
+    template <typename F, typename Futurator = Futurize<std::result_of_t<F()>>>
+    static typename Futurator::FutureType submit(F&& f);
 
-        if (found != _threads.end()) {
-            auto ptr = found->get();
-            ptr->scheduler.set_immediate(std::move(f));
-        }
-    }
+    // Same as submit(), but at most `limit` tasks submitted this way from the
+    // calling scheduler are on the pool at once; further ones wait on the caller,
+    // in order, until an earlier one completes. Callers chaining on the result
+    // are slowed down to the pool's pace instead of flooding its queues.
+    // Call from a scheduler thread.
+    template <typename F, typename Futurator = Futurize<std::result_of_t<F()>>>
+    static typename Futurator::FutureType submit_bounded(size_t limit, F&& f);
 
 private:
     struct Thread
     {
-        Thread()
-        {
-            thread = std::thread([this]() { scheduler.run(); });
-        }
+        Thread(IoBackend backend);
+        ~Thread();
+
+        // Runs tasks of the own deque, then stolen ones; false if there was none
+        bool work();
+        TaskCallback* steal();
 
         Scheduler scheduler;
+        StealingDeque<TaskCallback> deque;
+        std::atomic<bool> idle{false};
+        uint64_t random;
         std::thread thread;
     };
 
-    static auto find_thread()
+    static void wake_idle(Thread *self);
+
+    // submit_bounded() tasks of one scheduler thread
+    struct Backlog
     {
-        // use empty workers first
-        for (auto it = _threads.begin(); it != _threads.end(); ++it) {
-            if (it->get()->scheduler.count() == 0) {
-                return it;
-            }
-        }
+        size_t running = 0;
+        std::deque<UniqueFunction<void()>> waiting;
+    };
 
-        // then, round-robin
-        // TODO: select random thread to eliminate lock
-        static std::mutex mutex;
-        std::unique_lock<std::mutex> lock(mutex);
-        if (_current_thread++ >= _threads.size() - 1) {
-            _current_thread = 0;
-        }
+    template <typename Futurator, typename F, typename PromisePtr>
+    static void offload(F&& f, PromisePtr promise, Backlog *backlog);
 
-        return (_threads.begin() + _current_thread);
-    }
+    // Called on the owning thread when a task of the backlog completes
+    static void release(Backlog *backlog);
 
 private:
+    static constexpr size_t work_batch = 256;
+
     static std::vector<std::unique_ptr<Thread>> _threads;
-    static size_t _current_thread;
+    static std::atomic<size_t> _next;
+    static std::atomic<size_t> _idle;
+    static inline thread_local Thread *_local = nullptr;
+    static thread_local Backlog _backlog;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace BPromise
+{
+
+using TimePoint = std::chrono::time_point<std::chrono::steady_clock>;
+
+class TimerNode
+{
+public:
+    TimePoint deadline() const { return _deadline; }
+    bool armed() const { return _heap_index != npos; }
+
+private:
+    friend class TimerHeap;
+
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    TimePoint _deadline;
+    uint64_t _sequence = 0;
+    size_t _heap_index = npos;
+};
+
+// Indexed 4-ary min-heap ordered by deadline.
+// Every node remembers its own position, so push, remove and pop are O(log n)
+// and top is O(1). Nodes with equal deadlines are kept in insertion order.
+class TimerHeap
+{
+public:
+    bool empty() const { return _nodes.empty(); }
+    size_t size() const { return _nodes.size(); }
+    TimerNode* top() const { return _nodes.empty() ? nullptr : _nodes.front(); }
+
+    void push(TimerNode *node, TimePoint deadline);
+    void remove(TimerNode *node);
+    TimerNode* pop();
+
+private:
+    static constexpr size_t arity = 4;
+
+    static bool less(const TimerNode *a, const TimerNode *b)
+    {
+        return a->_deadline < b->_deadline || (a->_deadline == b->_deadline && a->_sequence < b->_sequence);
+    }
+
+    void place(size_t index, TimerNode *node)
+    {
+        _nodes[index] = node;
+        node->_heap_index = index;
+    }
+
+    void sift_up(size_t index);
+    void sift_down(size_t index);
+
+private:
+    std::vector<TimerNode*> _nodes;
+    uint64_t _sequence = 0;
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace BPromise
+{
+
+// Opt-in timeline of the runtime in the Chrome trace format, for
+// chrome://tracing or ui.perfetto.dev: tasks from enqueue to run (as flow
+// arrows between threads), promise continuations and socket syscalls.
+//
+// The trace points are compiled in with -DBPROMISE_TRACING=ON, and then cost
+// one relaxed load each until Tracer::enable(). Without the option they
+// compile to nothing. Events go to per-thread ring buffers of ring_size
+// events, the oldest are overwritten.
+class Tracer
+{
+public:
+    static constexpr size_t ring_size = 64 * 1024;
+
+    static void enable() { _enabled.store(true); }
+    static void disable() { _enabled.store(false); }
+    static bool enabled() { return _enabled.load(std::memory_order_relaxed); }
+
+    // Categories and names must outlive the trace, e.g. string literals.
+    // `code` is shown as an argument of the slice, see TaskCallback::code().
+    static void begin(const char *category, const char *name, const void *code = nullptr);
+    static void end(const char *category, const char *name);
+    static void instant(const char *category, const char *name);
+
+    // An arrow from here to the slice around flow_end() with the returned id
+    static uint64_t flow_start(const char *category, const char *name);
+    static void flow_end(const char *category, const char *name, uint64_t id);
+
+    // Track name of the calling thread
+    static void set_thread_name(std::string name);
+
+    // Threads write their buffers without synchronization, so dump and clear
+    // after disable(), once in-flight events are done
+    static std::string chrome_json();
+    static bool write(const std::string &path);
+    static void clear();
+
+private:
+    static inline std::atomic<bool> _enabled{false};
+};
+
+// Slice around its scope, if tracing was enabled at its start
+class TraceScope
+{
+public:
+    TraceScope(const char *category, const char *name, const void *code = nullptr) :
+        _category(category),
+        _name(name),
+        _active(Tracer::enabled())
+    {
+        if (_active) {
+            Tracer::begin(category, name, code);
+        }
+    }
+
+    ~TraceScope()
+    {
+        if (_active) {
+            Tracer::end(_category, _name);
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char *_category;
+    const char *_name;
+    bool _active;
+};
+
+}
+
+#if defined(BPROMISE_TRACING)
+#   define BPROMISE_TRACE_JOIN2(a, b) a##b
+#   define BPROMISE_TRACE_JOIN(a, b) BPROMISE_TRACE_JOIN2(a, b)
+#   define BPROMISE_TRACE_SCOPE(category, name) BPromise::TraceScope BPROMISE_TRACE_JOIN(trace_scope_, __LINE__)(category, name)
+#   define BPROMISE_TRACE_INSTANT(category, name) (BPromise::Tracer::enabled() ? BPromise::Tracer::instant(category, name) : void())
+#   define BPROMISE_TRACE_THREAD(name) BPromise::Tracer::set_thread_name(name)
+#else
+#   define BPROMISE_TRACE_SCOPE(category, name) ((void)0)
+#   define BPROMISE_TRACE_INSTANT(category, name) ((void)0)
+#   define BPROMISE_TRACE_THREAD(name) ((void)0)
+#endif
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bpromise/function.h"
+#include "bpromise/worker.h"
+
+namespace BPromise
+{
+
+struct StallReport
+{
+    std::string worker;                 // name given to StallDetector::watch()
+    std::chrono::milliseconds duration; // the loop has been stuck at least this long
+    const void *task = nullptr;         // TaskCallback::code() of the running task, nullptr between tasks (I/O callbacks)
+    std::vector<void*> backtrace;       // of the stalled thread, empty where unsupported
+    size_t suppressed = 0;              // reports dropped by the rate limit before this one
+};
+
+// Task and frames resolved to symbols where possible, one per line. Functions
+// of the executable itself are only named when it is linked with -rdynamic,
+// otherwise feed the addresses to addr2line.
+std::string format_stall(const StallReport &report);
+
+// Watchdog thread noticing Workers stuck in one task (or one reactor dispatch)
+// for longer than a threshold. It only compares counters the loop keeps anyway,
+// every threshold / 4; a stall is reported when it crosses the threshold and
+// again each time its duration doubles. On Linux the report carries a
+// backtrace of the stalled thread, taken in a SIGRTMIN handler.
+class StallDetector
+{
+public:
+    struct Options
+    {
+        std::chrono::milliseconds threshold{100};
+        std::chrono::milliseconds report_interval{1000}; // at most one report per interval, the others are counted
+        bool backtrace = true;
+        UniqueFunction<void(const StallReport&)> report; // called on the watchdog thread; format_stall() to stderr if empty
+    };
+
+    static void start(Options options);
+    static void stop();
+
+    // Watched workers must be unwatched before they are destroyed
+    static void watch(Worker &worker, std::string name);
+    static void unwatch(Worker &worker);
+
+private:
+    struct Watched
+    {
+        Worker *worker;
+        std::string name;
+        uint64_t progress = 0;
+        const void *task = nullptr;
+        TimePoint since;
+        std::chrono::steady_clock::duration next_report{};
+    };
+
+    static void run();
+
+    // Reports due for the worker, if it made no progress since `since`, along
+    // with the id of its thread; run() takes the backtraces outside the lock
+    static void check(Watched &watched, TimePoint now, std::vector<StallReport> &reports, std::vector<int> &threads);
+
+    static std::vector<void*> capture_backtrace(int thread_id);
+
+private:
+    static Options _options;
+    static std::vector<Watched> _watched;
+    static TimePoint _next_report;
+    static size_t _suppressed;
+    static bool _running;
+    static std::mutex _lock;
+    static std::condition_variable _wake;
+    static std::thread _thread;
+};
+
+}
@@ -1,30 +1,25 @@
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <chrono>
-#include <condition_variable>
-#include <functional>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <mutex>
-#include <vector>
+#include <new>
+#include <unordered_map>
+#include "bpromise/arena.h"
+#include "bpromise/function.h"
+#include "bpromise/queue.h"
+#include "bpromise/reactor.h"
+#include "bpromise/timers.h"
+#include "bpromise/trace.h"
 
 namespace BPromise
 {
 
-using TimePoint = std::chrono::time_point<std::chrono::steady_clock>;
-
-class WaitEvent
-{
-public:
-    void signal();
-    void wait();
-    void wait_until(TimePoint time);
-
-private:
-    std::condition_variable _wait;
-    std::mutex _waitlock;
-    bool _stopwait = false;
-};
+using TimerId = uint64_t;
 
 enum class TaskType
 {
@@ -32,31 +27,131 @@ enum class TaskType
     Periodic
 };
 
-class TaskCallback
+class TaskCallback : public TimerNode, public QueueNode
 {
 public:
+    // callables up to this size are stored inside the task node itself. A
+    // Promise takes 96 bytes, 128 with an (int, TemporaryBuffer) value; 192
+    // leaves room for a promise of either and a few captures beside it, so
+    // tasks resolving one stay out of the arena
+    static constexpr size_t inline_size = 192;
+
     template <typename Clock = std::chrono::steady_clock, typename Rep, typename Period, typename F>
     TaskCallback(TaskType type, std::chrono::duration<Rep, Period> interval, F&& f) :
         _callback(std::move(f)),
         _type(type),
         _interval(interval)
     {
-        reschedule(std::chrono::steady_clock::now());
     }
 
-    ~TaskCallback() { _wait.signal(); }
-
     TaskType type() const { return _type; }
-    TimePoint schedule() const { return _schedule; }
-    void execute();
-    void reschedule(TimePoint now) { _schedule = now + _interval; }
+    TimerId id() const { return _id; }
+    bool oversized() const { return _callback.heap_allocated(); }
+    const void* code() const { return _callback.target_code(); }
+    std::chrono::steady_clock::duration interval() const { return _interval; }
+
+    void execute()
+    {
+#if defined(BPROMISE_TRACING)
+        TraceScope scope("task", "run", code());
+        if (_trace_flow && Tracer::enabled()) {
+            Tracer::flow_end("task", "queued", _trace_flow);
+        }
+#endif
+        _callback();
+    }
 
 private:
-    std::function<void()> _callback;
+    friend class Worker;
+
+    UniqueFunction<void(), inline_size> _callback;
     TaskType _type;
     std::chrono::steady_clock::duration _interval;
-    TimePoint _schedule;
-    WaitEvent _wait;
+    TimerId _id = 0;
+    TimePoint _enqueued; // set on sampled immediate tasks only
+#if defined(BPROMISE_TRACING)
+    uint64_t _trace_flow = 0;
+#endif
+};
+
+// Free-list of task node blocks. Only the owning worker thread touches it.
+class TaskPool
+{
+public:
+    static constexpr size_t max_size = 4096;
+
+    TaskPool() = default;
+    ~TaskPool();
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    void* allocate()
+    {
+        auto block = _free;
+        if (block) {
+            _free = block->next;
+            --_size;
+        }
+        return block;
+    }
+
+    bool release(void *ptr)
+    {
+        if (_size == max_size) {
+            return false;
+        }
+        _free = new (ptr) Block{_free};
+        ++_size;
+        return true;
+    }
+
+private:
+    struct Block
+    {
+        Block *next;
+    };
+
+    Block *_free = nullptr;
+    size_t _size = 0;
+};
+
+struct TaskAllocationStats
+{
+    uint64_t pooled = 0;    // task nodes reused from the worker free-list
+    uint64_t allocated = 0; // task nodes taken from the global heap
+    uint64_t oversized = 0; // callables that did not fit inline storage
+};
+
+// Durations in power-of-two buckets: bucket n counts those under 2^n ns (and
+// from 2^(n-1) ns on), the last one everything longer as well
+struct LatencyHistogram
+{
+    static constexpr size_t bucket_count = 32;
+
+    std::array<uint64_t, bucket_count> buckets{};
+    uint64_t count = 0;
+    uint64_t sum_ns = 0;
+
+    // Upper bound of the bucket holding the q-quantile (0..1), in ns
+    uint64_t quantile(double q) const;
+    void merge(const LatencyHistogram &other);
+};
+
+// What a Worker's loop did since it was created. Run times and the delays of
+// immediate tasks are sampled, one task in Worker::sample_every on average.
+struct WorkerMetrics
+{
+    uint64_t immediate_tasks = 0;
+    uint64_t timer_tasks = 0;
+    uint64_t pool_tasks = 0;    // ThreadPool tasks run by the worker's thread
+    size_t immediate_depth = 0; // waiting in the immediate queue
+    size_t timer_depth = 0;     // pending timers
+    uint64_t wakeups = 0;       // the loop slept in the reactor and woke up
+    std::chrono::nanoseconds busy{0};
+    std::chrono::nanoseconds idle{0};
+    LatencyHistogram delay;     // enqueue to start of immediate tasks, deadline to start of timers
+    LatencyHistogram run_time;  // of the callbacks
 };
 
 class Worker
@@ -64,47 +159,181 @@ class Worker
 public:
     ~Worker();
 
+    // Worker running on the calling thread, nullptr outside of Worker::run()
+    static Worker* current() { return _thread_worker; }
+
+    static constexpr uint32_t sample_every = 16;
+
+    // Runs f on the next loop iteration, before any timer.
+    // Lock-free, and the clock is only read for the tasks sampled for metrics;
+    // the worker is only woken up if it is sleeping.
     template <typename F>
     void set_immediate(F&& f)
     {
-        schedule(TaskType::Oneshot, std::chrono::milliseconds(0), std::move(f));
+        auto task = make_task(TaskType::Oneshot, std::chrono::milliseconds(0), std::move(f));
+        if (sampled()) {
+            task->_enqueued = std::chrono::steady_clock::now();
+        }
+
+        _immediate_count.fetch_add(1, std::memory_order_relaxed);
+        _immediate.push(task);
+        if (_sleeping.load()) {
+            _reactor.wake();
+        }
     }
 
     template <typename Clock = std::chrono::steady_clock, typename Rep, typename Period, typename F>
-    void set_timeout(std::chrono::duration<Rep, Period> interval, F&& f)
+    TimerId set_timeout(std::chrono::duration<Rep, Period> interval, F&& f)
     {
-        schedule(TaskType::Oneshot, interval, std::move(f));
+        return schedule(TaskType::Oneshot, interval, std::move(f));
     }
 
     template <typename Clock = std::chrono::steady_clock, typename Rep, typename Period, typename F>
-    void set_interval(std::chrono::duration<Rep, Period> interval, F&& f)
+    TimerId set_interval(std::chrono::duration<Rep, Period> interval, F&& f)
     {
-        schedule(TaskType::Periodic, interval, std::move(f));
+        return schedule(TaskType::Periodic, interval, std::move(f));
     }
 
+    // Cancels a pending timeout or interval. Returns false if it already fired or was cleared.
+    bool clear_timer(TimerId id);
+
+    // Extra work polled once per loop iteration, e.g. ThreadPool's stealing deque.
+    // Returns true if it ran something, the worker does not sleep then.
+    // Set it before run().
+    void set_work_source(UniqueFunction<bool()> source) { _work_source = std::move(source); }
+
     size_t count();
+    TaskAllocationStats allocation_stats() const;
+
+    // Snapshot, callable from any thread; the counters stay on permanently
+    WorkerMetrics metrics();
+
+    Arena& arena() { return _arena; }
+    Reactor& reactor() { return _reactor; }
     void run();
     void stop();
 
 private:
+    friend class ThreadPool;
+    friend class StallDetector;
+
     template <typename Clock = std::chrono::steady_clock, typename Rep, typename Period, typename F>
-    void schedule(TaskType type, std::chrono::duration<Rep, Period> interval, F&& f)
+    TimerId schedule(TaskType type, std::chrono::duration<Rep, Period> interval, F&& f)
     {
-        auto task = std::make_shared<TaskCallback>(type, interval, std::move(f));
+        auto task = make_task(type, interval, std::move(f));
+        auto deadline = std::chrono::steady_clock::now() + task->interval();
 
         std::scoped_lock lock(_lock);
-        _tasks.push_back(task);
-        _wait.signal();
+        task->_id = ++_last_id;
+        _cancellable.emplace(task->_id, task);
+        _timers.push(task, deadline);
+        if (_timers.top() == task) {
+            _timers_changed.store(true);
+            if (_sleeping.load()) {
+                _reactor.wake();
+            }
+        }
+        return task->_id;
+    }
+
+    template <typename Rep, typename Period, typename F>
+    TaskCallback* make_task(TaskType type, std::chrono::duration<Rep, Period> interval, F&& f)
+    {
+        void *block = nullptr;
+        if (_thread_worker == this) {
+            block = _pool.allocate();
+        }
+
+        if (block) {
+            _pooled.store(_pooled.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        } else {
+            block = ::operator new(sizeof(TaskCallback));
+            _allocated.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        auto task = new (block) TaskCallback(type, interval, std::move(f));
+        if (task->oversized()) {
+            _oversized.fetch_add(1, std::memory_order_relaxed);
+        }
+#if defined(BPROMISE_TRACING)
+        if (Tracer::enabled()) {
+            task->_trace_flow = Tracer::flow_start("task", "queued");
+        }
+#endif
+        return task;
+    }
+
+    void run_immediate();
+    TimePoint run_timers();
+    void free_task(TaskCallback *task);
+
+    // Runs a timer or pool task, timing it if it is sampled, and counts it
+    void execute(TaskCallback *task, std::atomic<uint64_t> &counter);
+
+    // Written by the worker thread only, read by metrics()
+    struct HistogramCounters
+    {
+        std::atomic<uint64_t> buckets[LatencyHistogram::bucket_count] = {};
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sum_ns{0};
+
+        void record(std::chrono::steady_clock::duration duration);
+        LatencyHistogram snapshot() const;
+    };
+
+    // One call in sample_every on average. Random rather than every n-th, so
+    // threads spreading tasks over several workers sample all of them.
+    static bool sampled()
+    {
+        // xorshift32
+        _sample_random ^= _sample_random << 13;
+        _sample_random ^= _sample_random >> 17;
+        _sample_random ^= _sample_random << 5;
+        return _sample_random % sample_every == 0;
     }
 
-    void cancel_task(const std::shared_ptr<TaskCallback> &task);
+    static void add(std::atomic<uint64_t> &counter, uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
 
 private:
+    static constexpr size_t immediate_batch = 256;
+
+    static inline thread_local Worker *_thread_worker = nullptr;
+    static inline thread_local uint32_t _sample_random = 2463534242;
+
     std::atomic<bool> _running{false};
     std::atomic<bool> _wait_for_finish{false};
-    std::vector<std::shared_ptr<TaskCallback>> _tasks;
+    std::atomic<bool> _sleeping{false};
+    std::atomic<bool> _timers_changed{false};
+    std::atomic<size_t> _immediate_count{0};
+    std::atomic<uint64_t> _pooled{0};
+    std::atomic<uint64_t> _allocated{0};
+    std::atomic<uint64_t> _oversized{0};
+    std::atomic<uint64_t> _immediate_tasks{0};
+    std::atomic<uint64_t> _timer_tasks{0};
+    std::atomic<uint64_t> _pool_tasks{0};
+    std::atomic<uint64_t> _wakeups{0};
+    std::atomic<uint64_t> _busy_ns{0};
+    std::atomic<uint64_t> _idle_ns{0};
+    HistogramCounters _delay;
+    HistogramCounters _run_time;
+    // Progress watched by StallDetector from its own thread
+    std::atomic<uint64_t> _iterations{0};
+    std::atomic<const void*> _executing{nullptr}; // code() of the running task
+    std::atomic<int> _thread_id{0}; // kernel id of the thread in run(), Linux only
+    TaskQueue _immediate;
+    TaskPool _pool;
+    Arena _arena;
+    TimerHeap _timers;
+    std::unordered_map<TimerId, TaskCallback*> _cancellable;
+    TimerId _last_id = 0;
+    TaskCallback *_current = nullptr;
+    bool _current_cleared = false;
     std::mutex _lock;
-    WaitEvent _wait;
+    Reactor _reactor;
+    UniqueFunction<bool()> _work_source;
     WaitEvent _finish_wait;
 };
 
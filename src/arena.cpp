@@ -0,0 +1,38 @@
+#include "bpromise/arena.h"
+
+namespace BPromise
+{
+
+Arena::~Arena()
+{
+    release();
+}
+
+void Arena::set_enabled(bool enabled)
+{
+    _enabled = enabled;
+    if (!_enabled) {
+        release();
+    }
+}
+
+ArenaStats Arena::stats() const
+{
+    ArenaStats stats;
+    stats.reused = _reused.load(std::memory_order_relaxed);
+    stats.allocated = _allocated.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void Arena::release()
+{
+    for (size_t index = 0; index < class_count; ++index) {
+        while (auto block = _free[index]) {
+            _free[index] = block->next;
+            ::operator delete(block);
+        }
+        _cached[index] = 0;
+    }
+}
+
+}
\ No newline at end of file
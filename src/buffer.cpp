@@ -0,0 +1,88 @@
+#include "bpromise/buffer.h"
+#include <cstring>
+#include <new>
+#include "bpromise/arena.h"
+
+namespace BPromise
+{
+
+// Strings up to this size are copied into an arena block, which is cheaper
+// than a heap-allocated holder
+static constexpr size_t adopt_threshold = 512;
+
+TemporaryBuffer::TemporaryBuffer(size_t size)
+{
+    // header and bytes in one block
+    struct BlockStorage : Storage
+    {
+        size_t total;
+    };
+
+    auto total = sizeof(BlockStorage) + size;
+    auto storage = new (Arena::allocate(total)) BlockStorage();
+    storage->total = total;
+    storage->destroy = [](Storage *storage) {
+        auto block = static_cast<BlockStorage*>(storage);
+        auto total = block->total;
+        block->~BlockStorage();
+        Arena::deallocate(block, total);
+    };
+
+    _storage = storage;
+    _data = reinterpret_cast<char*>(storage + 1);
+    _size = size;
+}
+
+TemporaryBuffer::TemporaryBuffer(const char *data, size_t size) :
+    TemporaryBuffer(size)
+{
+    if (size) {
+        std::memcpy(_data, data, size);
+    }
+}
+
+TemporaryBuffer::TemporaryBuffer(std::string data)
+{
+    if (data.size() <= adopt_threshold) {
+        *this = TemporaryBuffer(data.data(), data.size());
+        return;
+    }
+
+    struct StringStorage : Storage
+    {
+        std::string data;
+    };
+
+    auto storage = new StringStorage();
+    storage->data = std::move(data);
+    storage->destroy = [](Storage *storage) {
+        delete static_cast<StringStorage*>(storage);
+    };
+
+    _storage = storage;
+    _data = storage->data.data();
+    _size = storage->data.size();
+}
+
+// Arena blocks have no such alignment, these come from the heap
+TemporaryBuffer TemporaryBuffer::aligned(size_t alignment, size_t size)
+{
+    struct AlignedStorage : Storage
+    {
+        char *data;
+        size_t alignment;
+    };
+
+    auto storage = new AlignedStorage();
+    storage->data = static_cast<char*>(::operator new(size, std::align_val_t(alignment)));
+    storage->alignment = alignment;
+    storage->destroy = [](Storage *storage) {
+        auto aligned = static_cast<AlignedStorage*>(storage);
+        ::operator delete(aligned->data, std::align_val_t(aligned->alignment));
+        delete aligned;
+    };
+
+    return TemporaryBuffer(storage, storage->data, size);
+}
+
+}
@@ -0,0 +1,374 @@
+#include "bpromise/file.h"
+#include "bpromise/threadpool.h"
+#include <algorithm>
+#include <cerrno>
+
+#if defined(_WIN32)
+#   define IS_WIN
+#elif defined(unix) || defined(__unix__) || defined(__unix)
+#   include <fcntl.h>
+#   include <unistd.h>
+#   define IS_UNIX
+#endif
+
+namespace BPromise
+{
+
+#if defined(BPROMISE_HAS_IO_URING)
+
+// The reactor of the calling Worker if it runs io_uring
+static Reactor* uring_reactor()
+{
+    auto& reactor = this_scheduler().reactor();
+    return reactor.backend() == IoBackend::IoUring ? &reactor : nullptr;
+}
+
+// A read or write, resubmitted for the rest after a short transfer until all of
+// it is done or the end of file is reached. Deletes itself once resolved.
+struct TransferRequest final : IoCompletion
+{
+    TransferRequest(Reactor &reactor, int fd, uint64_t pos, TemporaryBuffer data, bool write) :
+        reactor(reactor),
+        fd(fd),
+        pos(pos),
+        data(std::move(data)),
+        write(write)
+    {
+    }
+
+    void submit()
+    {
+        if (write) {
+            reactor.submit_write(fd, data.get() + done, data.size() - done, pos + done, this);
+        } else {
+            reactor.submit_read(fd, data.get_write() + done, data.size() - done, pos + done, this);
+        }
+    }
+
+    void complete(int result, bool, const char*) override
+    {
+        if (result > 0) {
+            done += result;
+            if (done < data.size()) {
+                submit();
+                return;
+            }
+        }
+
+        std::unique_ptr<TransferRequest> self(this);
+        int size = result < 0 ? -1 : static_cast<int>(done);
+        if (write) {
+            written.set_value(size);
+        } else {
+            data.trim(result < 0 ? 0 : done);
+            read.set_value(size, std::move(data));
+        }
+    }
+
+    Reactor &reactor;
+    int fd;
+    uint64_t pos;
+    TemporaryBuffer data;
+    size_t done = 0;
+    bool write;
+    BPromise::Promise<int, TemporaryBuffer> read;
+    BPromise::Promise<int> written;
+};
+
+// fsync or close, resolves with the result. Deletes itself.
+struct ResultRequest final : IoCompletion
+{
+    void complete(int result, bool, const char*) override
+    {
+        auto resolved = std::move(promise);
+        delete this;
+        resolved.set_value(result < 0 ? -1 : 0);
+    }
+
+    BPromise::Promise<int> promise;
+};
+
+#endif
+
+#if defined(IS_UNIX)
+
+AsyncFile::AsyncFile(int fd, bool direct) :
+    _fd(fd),
+    _direct(direct)
+{
+}
+
+AsyncFile::~AsyncFile()
+{
+    if (_fd >= 0) {
+        close();
+    }
+}
+
+AsyncFile::AsyncFile(AsyncFile&& other) :
+    _fd(other._fd),
+    _error(other._error),
+    _direct(other._direct)
+{
+    other._fd = -1;
+}
+
+AsyncFile& AsyncFile::operator=(AsyncFile&& other)
+{
+    if (this != &other) {
+        if (_fd >= 0) {
+            close();
+        }
+        _fd = other._fd;
+        _error = other._error;
+        _direct = other._direct;
+        other._fd = -1;
+    }
+    return *this;
+}
+
+// Opening walks the path and may wait for the disk, always on the pool
+BPromise::Future<AsyncFile> AsyncFile::open(std::string path, int flags, int mode)
+{
+    return BPromise::ThreadPool::submit([path = std::move(path), flags, mode]() {
+        int fd;
+        do {
+            fd = ::open(path.c_str(), flags | O_CLOEXEC, mode);
+        } while (fd < 0 && errno == EINTR);
+
+        if (fd < 0) {
+            AsyncFile file;
+            file._error = errno;
+            return file;
+        }
+
+#if defined(O_DIRECT)
+        return AsyncFile(fd, (flags & O_DIRECT) != 0);
+#else
+        return AsyncFile(fd, false);
+#endif
+    });
+}
+
+TemporaryBuffer AsyncFile::allocate(size_t size) const
+{
+    return _direct ? TemporaryBuffer::aligned(alignment, size) : TemporaryBuffer(size);
+}
+
+BPromise::Future<int, TemporaryBuffer> AsyncFile::read(uint64_t pos, size_t size)
+{
+    if (_fd < 0) {
+        return BPromise::make_ready_future<int, TemporaryBuffer>(-1, TemporaryBuffer());
+    }
+
+    auto buffer = allocate(size);
+
+#if defined(BPROMISE_HAS_IO_URING)
+    if (auto reactor = uring_reactor()) {
+        auto request = new TransferRequest(*reactor, _fd, pos, std::move(buffer), false);
+        auto future = request->read.get_future();
+        request->submit();
+        return future;
+    }
+#endif
+
+    return BPromise::ThreadPool::submit([fd = _fd, pos, buffer = std::move(buffer)]() mutable {
+        size_t done = 0;
+        while (done < buffer.size()) {
+            auto result = ::pread(fd, buffer.get_write() + done, buffer.size() - done, static_cast<off_t>(pos + done));
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            if (result < 0) {
+                return BPromise::make_ready_future<int, TemporaryBuffer>(-1, TemporaryBuffer());
+            }
+            if (result == 0) {
+                break;
+            }
+            done += result;
+        }
+
+        buffer.trim(done);
+        return BPromise::make_ready_future<int, TemporaryBuffer>(static_cast<int>(done), std::move(buffer));
+    });
+}
+
+BPromise::Future<int> AsyncFile::write(uint64_t pos, TemporaryBuffer data)
+{
+    if (_fd < 0) {
+        return BPromise::make_ready_future<int>(-1);
+    }
+
+#if defined(BPROMISE_HAS_IO_URING)
+    if (auto reactor = uring_reactor()) {
+        auto request = new TransferRequest(*reactor, _fd, pos, std::move(data), true);
+        auto future = request->written.get_future();
+        request->submit();
+        return future;
+    }
+#endif
+
+    return BPromise::ThreadPool::submit([fd = _fd, pos, data = std::move(data)]() {
+        size_t done = 0;
+        while (done < data.size()) {
+            auto result = ::pwrite(fd, data.get() + done, data.size() - done, static_cast<off_t>(pos + done));
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            if (result < 0) {
+                return -1;
+            }
+            done += result;
+        }
+        return static_cast<int>(done);
+    });
+}
+
+BPromise::Future<int> AsyncFile::fsync(bool data_only)
+{
+    if (_fd < 0) {
+        return BPromise::make_ready_future<int>(-1);
+    }
+
+#if defined(BPROMISE_HAS_IO_URING)
+    if (auto reactor = uring_reactor()) {
+        auto request = new ResultRequest();
+        auto future = request->promise.get_future();
+        reactor->submit_fsync(_fd, data_only, request);
+        return future;
+    }
+#endif
+
+    return BPromise::ThreadPool::submit([fd = _fd, data_only]() {
+#if defined(__APPLE__)
+        (void)data_only;
+        return ::fsync(fd) < 0 ? -1 : 0;
+#else
+        return (data_only ? ::fdatasync(fd) : ::fsync(fd)) < 0 ? -1 : 0;
+#endif
+    });
+}
+
+BPromise::Future<> AsyncFile::close()
+{
+    auto fd = _fd;
+    _fd = -1;
+    if (fd < 0) {
+        return BPromise::make_ready_future<>();
+    }
+
+#if defined(BPROMISE_HAS_IO_URING)
+    if (auto reactor = uring_reactor()) {
+        auto request = new ResultRequest();
+        auto future = request->promise.get_future();
+        reactor->submit_close(fd, request);
+        return future.then([](int) {});
+    }
+#endif
+
+    return BPromise::ThreadPool::submit([fd]() {
+        ::close(fd);
+    });
+}
+
+#else
+
+// No file support on this platform yet: open() fails with ENOSYS
+
+AsyncFile::AsyncFile(int fd, bool direct) :
+    _fd(fd),
+    _direct(direct)
+{
+}
+
+AsyncFile::~AsyncFile() = default;
+
+AsyncFile::AsyncFile(AsyncFile&& other) :
+    _fd(other._fd),
+    _error(other._error),
+    _direct(other._direct)
+{
+    other._fd = -1;
+}
+
+AsyncFile& AsyncFile::operator=(AsyncFile&& other)
+{
+    _fd = other._fd;
+    _error = other._error;
+    _direct = other._direct;
+    other._fd = -1;
+    return *this;
+}
+
+BPromise::Future<AsyncFile> AsyncFile::open(std::string, int, int)
+{
+    AsyncFile file;
+    file._error = ENOSYS;
+    return BPromise::make_ready_future<AsyncFile>(std::move(file));
+}
+
+TemporaryBuffer AsyncFile::allocate(size_t size) const
+{
+    return TemporaryBuffer(size);
+}
+
+BPromise::Future<int, TemporaryBuffer> AsyncFile::read(uint64_t, size_t)
+{
+    return BPromise::make_ready_future<int, TemporaryBuffer>(-1, TemporaryBuffer());
+}
+
+BPromise::Future<int> AsyncFile::write(uint64_t, TemporaryBuffer)
+{
+    return BPromise::make_ready_future<int>(-1);
+}
+
+BPromise::Future<int> AsyncFile::fsync(bool)
+{
+    return BPromise::make_ready_future<int>(-1);
+}
+
+BPromise::Future<> AsyncFile::close()
+{
+    return BPromise::make_ready_future<>();
+}
+
+#endif
+
+BPromise::Future<int> AsyncFile::write(uint64_t pos, std::string data)
+{
+    return write(pos, TemporaryBuffer(std::move(data)));
+}
+
+FileReader::FileReader(AsyncFile &file, uint64_t pos, size_t chunk_size, size_t ahead) :
+    _file(file),
+    _pos(pos),
+    _chunk_size(chunk_size),
+    _ahead(std::max<size_t>(ahead, 1))
+{
+}
+
+// Reads issued past the end resolve with 0 and are dropped
+BPromise::Future<int, TemporaryBuffer> FileReader::read()
+{
+    while (!_end && _reads.size() < _ahead) {
+        _reads.push_back(_file.read(_pos, _chunk_size));
+        _pos += _chunk_size;
+    }
+
+    if (_reads.empty()) {
+        return BPromise::make_ready_future<int, TemporaryBuffer>(0, TemporaryBuffer());
+    }
+
+    auto next = std::move(_reads.front());
+    _reads.pop_front();
+
+    return next.then([this](int result, TemporaryBuffer data) {
+        if (result < static_cast<int>(_chunk_size)) {
+            _end = true;
+            _reads.clear();
+        }
+        return BPromise::make_ready_future<int, TemporaryBuffer>(result, std::move(data));
+    });
+}
+
+}
@@ -0,0 +1,153 @@
+#include "bpromise/metrics.h"
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include "bpromise/stream.h"
+#include "bpromise/threadpool.h"
+
+namespace BPromise
+{
+
+static void append(std::string &out, const char *format, ...)
+{
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    auto size = std::vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    out.append(line, std::min<size_t>(size, sizeof(line) - 1));
+}
+
+static double seconds(uint64_t ns)
+{
+    return static_cast<double>(ns) / 1e9;
+}
+
+static void append_histogram(std::string &out, const char *name, const std::string &worker, const LatencyHistogram &histogram)
+{
+    uint64_t cumulative = 0;
+    for (size_t n = 0; n + 1 < LatencyHistogram::bucket_count; ++n) {
+        cumulative += histogram.buckets[n];
+        append(out, "%s_bucket{worker=\"%s\",le=\"%g\"} %llu\n", name, worker.c_str(), seconds(uint64_t(1) << n),
+            static_cast<unsigned long long>(cumulative));
+    }
+    cumulative += histogram.buckets[LatencyHistogram::bucket_count - 1];
+    append(out, "%s_bucket{worker=\"%s\",le=\"+Inf\"} %llu\n", name, worker.c_str(), static_cast<unsigned long long>(cumulative));
+    append(out, "%s_sum{worker=\"%s\"} %.9f\n", name, worker.c_str(), seconds(histogram.sum_ns));
+    append(out, "%s_count{worker=\"%s\"} %llu\n", name, worker.c_str(), static_cast<unsigned long long>(histogram.count));
+}
+
+std::string format_prometheus(const std::vector<std::pair<std::string, WorkerMetrics>> &workers)
+{
+    std::string out;
+
+    out += "# HELP bpromise_tasks_total Tasks run by the worker loop.\n# TYPE bpromise_tasks_total counter\n";
+    for (auto& [worker, metrics] : workers) {
+        append(out, "bpromise_tasks_total{worker=\"%s\",kind=\"immediate\"} %llu\n", worker.c_str(), static_cast<unsigned long long>(metrics.immediate_tasks));
+        append(out, "bpromise_tasks_total{worker=\"%s\",kind=\"timer\"} %llu\n", worker.c_str(), static_cast<unsigned long long>(metrics.timer_tasks));
+        append(out, "bpromise_tasks_total{worker=\"%s\",kind=\"pool\"} %llu\n", worker.c_str(), static_cast<unsigned long long>(metrics.pool_tasks));
+    }
+
+    out += "# HELP bpromise_queue_depth Tasks waiting in the worker's queues.\n# TYPE bpromise_queue_depth gauge\n";
+    for (auto& [worker, metrics] : workers) {
+        append(out, "bpromise_queue_depth{worker=\"%s\",queue=\"immediate\"} %zu\n", worker.c_str(), metrics.immediate_depth);
+        append(out, "bpromise_queue_depth{worker=\"%s\",queue=\"timers\"} %zu\n", worker.c_str(), metrics.timer_depth);
+    }
+
+    out += "# HELP bpromise_wakeups_total Times the worker slept in its reactor and woke up.\n# TYPE bpromise_wakeups_total counter\n";
+    for (auto& [worker, metrics] : workers) {
+        append(out, "bpromise_wakeups_total{worker=\"%s\"} %llu\n", worker.c_str(), static_cast<unsigned long long>(metrics.wakeups));
+    }
+
+    out += "# HELP bpromise_busy_seconds_total Time the worker loop spent running.\n# TYPE bpromise_busy_seconds_total counter\n";
+    for (auto& [worker, metrics] : workers) {
+        append(out, "bpromise_busy_seconds_total{worker=\"%s\"} %.9f\n", worker.c_str(), seconds(metrics.busy.count()));
+    }
+
+    out += "# HELP bpromise_idle_seconds_total Time the worker loop spent asleep.\n# TYPE bpromise_idle_seconds_total counter\n";
+    for (auto& [worker, metrics] : workers) {
+        append(out, "bpromise_idle_seconds_total{worker=\"%s\"} %.9f\n", worker.c_str(), seconds(metrics.idle.count()));
+    }
+
+    out += "# HELP bpromise_task_delay_seconds Enqueue (or timer deadline) to start of sampled tasks.\n# TYPE bpromise_task_delay_seconds histogram\n";
+    for (auto& [worker, metrics] : workers) {
+        append_histogram(out, "bpromise_task_delay_seconds", worker, metrics.delay);
+    }
+
+    out += "# HELP bpromise_task_run_seconds Run time of sampled tasks.\n# TYPE bpromise_task_run_seconds histogram\n";
+    for (auto& [worker, metrics] : workers) {
+        append_histogram(out, "bpromise_task_run_seconds", worker, metrics.run_time);
+    }
+
+    return out;
+}
+
+std::string prometheus_metrics()
+{
+    std::vector<std::pair<std::string, WorkerMetrics>> workers;
+    workers.emplace_back("main", MainThread::metrics());
+
+    auto pool = ThreadPool::metrics();
+    for (size_t n = 0; n < pool.size(); ++n) {
+        workers.emplace_back("pool-" + std::to_string(n), pool[n]);
+    }
+
+    return format_prometheus(workers);
+}
+
+namespace
+{
+
+struct MetricsConnection
+{
+    explicit MetricsConnection(ConnectedSocket s) :
+        socket(std::move(s)),
+        input(socket)
+    {
+    }
+
+    ConnectedSocket socket;
+    InputStream input;
+};
+
+}
+
+// One response per connection, whatever the request asked for
+static void serve_metrics(ConnectedSocket client)
+{
+    BPromise::do_with(std::make_unique<MetricsConnection>(std::move(client)), [](std::unique_ptr<MetricsConnection> &c) {
+        return c->input.read_until("\r\n\r\n").then([&c](TemporaryBuffer request) {
+            if (request.empty()) {
+                return BPromise::make_ready_future<int>(-1);
+            }
+
+            auto body = prometheus_metrics();
+            std::string response = "HTTP/1.0 200 OK\r\n"
+                "Content-Type: text/plain; version=0.0.4\r\n"
+                "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                "Connection: close\r\n\r\n";
+            response += body;
+            return c->socket.send(std::move(response));
+        }).then([&c](int) {
+            return c->socket.close();
+        });
+    });
+}
+
+MetricsEndpoint::MetricsEndpoint(int port) :
+    _server(std::make_unique<ServerSocket>(port))
+{
+    // the server socket resolves the pending accept with an invalid socket
+    // when it is closed, which ends the loop
+    BPromise::repeat([server = _server.get()]() {
+        return server->accept().then([](ConnectedSocket client) {
+            if (!client.valid()) {
+                return BPromise::make_ready_future<bool>(false);
+            }
+            serve_metrics(std::move(client));
+            return BPromise::make_ready_future<bool>(true);
+        });
+    });
+}
+
+}
@@ -0,0 +1,818 @@
+#include "bpromise/reactor.h"
+#include <algorithm>
+
+#if defined(BPROMISE_HAS_EPOLL)
+#   include <sys/epoll.h>
+#   include <sys/eventfd.h>
+#   include <unistd.h>
+#   include <cerrno>
+#   include <system_error>
+#endif
+
+#if defined(BPROMISE_HAS_IO_URING)
+#   include <linux/io_uring.h>
+#   include <poll.h>
+#   include <sys/mman.h>
+#   include <sys/socket.h>
+#   include <sys/syscall.h>
+#   include <cstring>
+#endif
+
+namespace BPromise
+{
+
+void WaitEvent::signal()
+{
+    {
+        std::scoped_lock lock(_waitlock);
+        _stopwait = true;
+    }
+    _wait.notify_all();
+}
+
+void WaitEvent::wait()
+{
+    std::unique_lock lock(_waitlock);
+    _wait.wait(lock, [this]() { return _stopwait; });
+    _stopwait = false;
+}
+
+void WaitEvent::wait_until(TimePoint time)
+{
+    std::unique_lock lock(_waitlock);
+    _wait.wait_until(lock, time, [this]() { return _stopwait; });
+    _stopwait = false;
+}
+
+
+PollableFd::PollableFd(Reactor &reactor, int fd) :
+    _reactor(reactor),
+    _fd(fd)
+{
+    _reactor.add(this);
+    _reactor.acquire_slot(this);
+}
+
+PollableFd::~PollableFd()
+{
+    _reactor.remove(this);
+    _reactor.release_slot(this);
+    fail_waiters();
+}
+
+void PollableFd::fail_waiters()
+{
+    _closed = true;
+
+    auto& deferred = _reactor._deferred;
+    deferred.erase(std::remove(deferred.begin(), deferred.end(), this), deferred.end());
+    std::replace(_reactor._deferring.begin(), _reactor._deferring.end(), this, static_cast<PollableFd*>(nullptr));
+
+    // waiters see closed() and fail their operation
+    while (!_readers.empty() || !_writers.empty() || !_deferred.empty()) {
+        auto& waiters = !_readers.empty() ? _readers : !_writers.empty() ? _writers : _deferred;
+        auto waiter = std::move(waiters.front());
+        waiters.pop_front();
+        waiter();
+    }
+}
+
+void PollableFd::notify(bool readable, bool writable)
+{
+    Guard guard(*this);
+
+    if (readable) {
+        run(_readers, guard);
+    }
+
+    if (writable && guard.alive()) {
+        run(_writers, guard);
+    }
+}
+
+// Waiters parked again while running (EAGAIN) wait for the next edge
+void PollableFd::run(std::deque<Waiter> &waiters, Guard &guard)
+{
+    for (auto count = waiters.size(); count > 0 && guard.alive() && !waiters.empty(); --count) {
+        auto waiter = std::move(waiters.front());
+        waiters.pop_front();
+        waiter();
+    }
+}
+
+void PollableFd::defer(Waiter waiter)
+{
+    if (_deferred.empty()) {
+        _reactor._deferred.push_back(this);
+    }
+    _deferred.push_back(std::move(waiter));
+}
+
+void Reactor::acquire_slot(PollableFd *fd)
+{
+    if (_free_slots.empty()) {
+        _free_slots.push_back(static_cast<uint32_t>(_generations.size()));
+        _generations.push_back(0);
+    }
+
+    fd->_slot = _free_slots.back();
+    fd->_generation = _generations[fd->_slot];
+    _free_slots.pop_back();
+}
+
+void Reactor::release_slot(PollableFd *fd)
+{
+    ++_generations[fd->_slot];
+    _free_slots.push_back(fd->_slot);
+}
+
+// Waiters deferred again while running go to the next round
+void Reactor::run_deferred()
+{
+    if (_deferred.empty()) {
+        return;
+    }
+
+    _deferring.swap(_deferred);
+
+    for (size_t n = 0; n < _deferring.size(); ++n) {
+        auto fd = _deferring[n];
+        if (!fd) {
+            continue;
+        }
+
+        // a waiter deferring again while the queue is not empty yet doesn't register it
+        PollableFd::Guard guard(*fd);
+        fd->run(fd->_deferred, guard);
+        if (guard.alive() && !fd->_deferred.empty() && std::find(_deferred.begin(), _deferred.end(), fd) == _deferred.end()) {
+            _deferred.push_back(fd);
+        }
+    }
+
+    _deferring.clear();
+}
+
+#if defined(BPROMISE_HAS_IO_URING)
+
+// Minimal io_uring ring on raw syscalls: submission/completion rings plus a
+// ring of provided buffers for multishot recv.
+class Uring
+{
+public:
+    static constexpr unsigned entries = 256;
+    static constexpr unsigned cq_entries = 4096;
+    static constexpr unsigned buffer_count = 512; // power of two
+    static constexpr unsigned buffer_size = 4096;
+    static constexpr uint16_t buffer_group = 0;
+
+    ~Uring()
+    {
+        if (_buffers) {
+            ::munmap(_buffer_ring, buffer_count * sizeof(io_uring_buf));
+            delete[] _buffers;
+        }
+        if (_sqes) {
+            ::munmap(_sqes, _sq_entries * sizeof(io_uring_sqe));
+        }
+        if (_ring) {
+            ::munmap(_ring, _ring_size);
+        }
+        if (_fd >= 0) {
+            ::close(_fd);
+        }
+    }
+
+    // Sets the ring up, false if the kernel lacks io_uring or the features we rely on
+    bool setup()
+    {
+        io_uring_params params{};
+        params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+        params.cq_entries = cq_entries;
+
+        _fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        if (_fd < 0) {
+            return false;
+        }
+
+        // EXT_ARG: 5.11, RSRC_TAGS: 5.13 (multishot poll)
+        constexpr unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP
+            | IORING_FEAT_EXT_ARG | IORING_FEAT_RSRC_TAGS;
+        if ((params.features & required) != required) {
+            return false;
+        }
+
+        _ring_size = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+            params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+        _ring = ::mmap(nullptr, _ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+        if (_ring == MAP_FAILED) {
+            _ring = nullptr;
+            return false;
+        }
+
+        auto sqes = ::mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            return false;
+        }
+        _sqes = static_cast<io_uring_sqe*>(sqes);
+
+        auto ring = static_cast<char*>(_ring);
+        _sq_head = reinterpret_cast<unsigned*>(ring + params.sq_off.head);
+        _sq_tail = reinterpret_cast<unsigned*>(ring + params.sq_off.tail);
+        _sq_mask = *reinterpret_cast<unsigned*>(ring + params.sq_off.ring_mask);
+        _sq_entries = params.sq_entries;
+        _cq_head = reinterpret_cast<unsigned*>(ring + params.cq_off.head);
+        _cq_tail = reinterpret_cast<unsigned*>(ring + params.cq_off.tail);
+        _cq_mask = *reinterpret_cast<unsigned*>(ring + params.cq_off.ring_mask);
+        _cqes = reinterpret_cast<io_uring_cqe*>(ring + params.cq_off.cqes);
+
+        // submission slots map 1:1 to sqes
+        auto array = reinterpret_cast<unsigned*>(ring + params.sq_off.array);
+        for (unsigned n = 0; n < _sq_entries; ++n) {
+            array[n] = n;
+        }
+        _tail = *_sq_tail;
+
+        return true;
+    }
+
+    // Registers the provided buffer ring (5.19), false if not supported
+    bool setup_buffers()
+    {
+        auto ring = ::mmap(nullptr, buffer_count * sizeof(io_uring_buf), PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ring == MAP_FAILED) {
+            return false;
+        }
+
+        io_uring_buf_reg reg{};
+        reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+        reg.ring_entries = buffer_count;
+        reg.bgid = buffer_group;
+        if (::syscall(__NR_io_uring_register, _fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+            ::munmap(ring, buffer_count * sizeof(io_uring_buf));
+            return false;
+        }
+
+        _buffer_ring = static_cast<io_uring_buf*>(ring);
+        _buffers = new char[buffer_count * buffer_size];
+        for (unsigned n = 0; n < buffer_count; ++n) {
+            recycle(n);
+        }
+        return true;
+    }
+
+    const char* buffer(unsigned id) const { return _buffers + id * buffer_size; }
+
+    // io_uring_buf_ring::bufs cannot be used from C++ (its empty struct shifts it),
+    // the ring is an array of io_uring_buf whose first resv field is the tail
+    void recycle(unsigned id)
+    {
+        auto& buf = _buffer_ring[_buffer_tail & (buffer_count - 1)];
+        buf.addr = reinterpret_cast<uint64_t>(_buffers + id * buffer_size);
+        buf.len = buffer_size;
+        buf.bid = static_cast<uint16_t>(id);
+        ++_buffer_tail;
+        __atomic_store_n(&_buffer_ring[0].resv, _buffer_tail, __ATOMIC_RELEASE);
+    }
+
+    // Next free submission entry, submits the queued ones first if the ring is full
+    io_uring_sqe* next(uint64_t user_data, uint64_t &syscalls)
+    {
+        if (_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) >= _sq_entries) {
+            enter(0, nullptr);
+            ++syscalls;
+        }
+
+        auto sqe = &_sqes[_tail & _sq_mask];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->user_data = user_data;
+        ++_tail;
+        return sqe;
+    }
+
+    unsigned pending() const { return _tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE); }
+    bool ready() const { return *_cq_head != __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE); }
+
+    // Submits queued entries and waits for `wait` completions or the timeout
+    void enter(unsigned wait, const __kernel_timespec *timeout)
+    {
+        __atomic_store_n(_sq_tail, _tail, __ATOMIC_RELEASE);
+
+        unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+        io_uring_getevents_arg arg{};
+        void *argp = nullptr;
+        size_t argsz = 0;
+        if (timeout) {
+            arg.ts = reinterpret_cast<uint64_t>(timeout);
+            flags |= IORING_ENTER_EXT_ARG;
+            argp = &arg;
+            argsz = sizeof(arg);
+        }
+
+        // ETIME, EINTR and EBUSY (completion backlog) all end up in reaping completions
+        ::syscall(__NR_io_uring_enter, _fd, pending(), wait, flags, argp, argsz);
+    }
+
+    // Calls f(user_data, result, flags) for every available completion
+    template <typename F>
+    unsigned reap(F&& f)
+    {
+        unsigned head = *_cq_head;
+        unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+        unsigned count = tail - head;
+
+        while (head != tail) {
+            auto cqe = _cqes[head & _cq_mask];
+            __atomic_store_n(_cq_head, ++head, __ATOMIC_RELEASE);
+            f(cqe.user_data, cqe.res, cqe.flags);
+        }
+        return count;
+    }
+
+private:
+    int _fd = -1;
+    void *_ring = nullptr;
+    size_t _ring_size = 0;
+    io_uring_sqe *_sqes = nullptr;
+    unsigned *_sq_head = nullptr;
+    unsigned *_sq_tail = nullptr;
+    unsigned _sq_mask = 0;
+    unsigned _sq_entries = 0;
+    unsigned _tail = 0;
+    unsigned *_cq_head = nullptr;
+    unsigned *_cq_tail = nullptr;
+    unsigned _cq_mask = 0;
+    io_uring_cqe *_cqes = nullptr;
+    io_uring_buf *_buffer_ring = nullptr;
+    char *_buffers = nullptr;
+    uint16_t _buffer_tail = 0;
+};
+
+// user_data of requests that are not IoCompletions
+static constexpr uint64_t ignored_request = 0;
+static constexpr uint64_t epoll_request = 1;
+
+#endif
+
+#if defined(BPROMISE_HAS_EPOLL)
+
+Reactor::Reactor()
+{
+    _epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (_epoll < 0) {
+        throw std::system_error(errno, std::generic_category(), "epoll_create1");
+    }
+
+    _wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_wakeup < 0) {
+        ::close(_epoll);
+        throw std::system_error(errno, std::generic_category(), "eventfd");
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLET;
+    event.data.ptr = this;
+    epoll_ctl(_epoll, EPOLL_CTL_ADD, _wakeup, &event);
+
+    _events = new epoll_event[max_events];
+}
+
+Reactor::~Reactor()
+{
+#if defined(BPROMISE_HAS_IO_URING)
+    drain();
+    _uring.reset();
+#endif
+    delete[] _events;
+    ::close(_wakeup);
+    ::close(_epoll);
+}
+
+IoBackend Reactor::set_backend(IoBackend backend)
+{
+#if defined(BPROMISE_HAS_IO_URING)
+    if (backend == IoBackend::IoUring && !_uring) {
+        auto uring = std::make_unique<Uring>();
+        if (uring->setup()) {
+            _multishot = uring->setup_buffers();
+            _uring = std::move(uring);
+            _backend = IoBackend::IoUring;
+            watch_epoll();
+        }
+    } else if (backend == IoBackend::Epoll) {
+        _uring.reset();
+        _backend = IoBackend::Epoll;
+    }
+#endif
+    return _backend;
+}
+
+void Reactor::wait(TimePoint deadline)
+{
+    // deferred waiters run right after this poll
+    if (!_deferred.empty()) {
+        deadline = TimePoint::min();
+    }
+
+#if defined(BPROMISE_HAS_IO_URING)
+    if (_uring) {
+        // completions already posted need neither a submission nor a wait
+        if (_uring->pending() == 0 && (deadline == TimePoint::min() || _uring->ready())) {
+            return;
+        }
+
+        __kernel_timespec timeout{};
+        if (deadline != TimePoint::max() && deadline != TimePoint::min()) {
+            auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now()).count();
+            left = left < 0 ? 0 : left;
+            timeout.tv_sec = left / 1000000000;
+            timeout.tv_nsec = left % 1000000000;
+        }
+
+        bump(_syscalls);
+        _uring->enter(deadline == TimePoint::min() ? 0 : 1, deadline == TimePoint::max() ? nullptr : &timeout);
+        return;
+    }
+#endif
+
+    int timeout = -1;
+    if (deadline == TimePoint::min()) {
+        timeout = 0;
+    } else if (deadline != TimePoint::max()) {
+        auto left = deadline - std::chrono::steady_clock::now();
+        auto ms = std::chrono::ceil<std::chrono::milliseconds>(left).count();
+        timeout = ms < 0 ? 0 : (ms > INT32_MAX ? INT32_MAX : static_cast<int>(ms));
+    }
+
+    poll_epoll(timeout);
+}
+
+void Reactor::dispatch()
+{
+#if defined(BPROMISE_HAS_IO_URING)
+    if (_uring) {
+        dispatch_uring();
+        run_deferred();
+        return;
+    }
+#endif
+
+    dispatch_epoll();
+    run_deferred();
+}
+
+void Reactor::poll_epoll(int timeout)
+{
+    bump(_syscalls);
+    auto count = epoll_wait(_epoll, _events, max_events, timeout);
+    _ready = count > 0 ? count : 0;
+}
+
+void Reactor::dispatch_epoll()
+{
+    for (int n = 0; n < _ready; ++n) {
+        auto& event = _events[n];
+
+        if (event.data.ptr == this) {
+            uint64_t value;
+            while (::read(_wakeup, &value, sizeof(value)) > 0) {
+                bump(_syscalls);
+            }
+            bump(_syscalls);
+        } else if (event.data.ptr) {
+            auto fd = static_cast<PollableFd*>(event.data.ptr);
+            bool failed = event.events & (EPOLLERR | EPOLLHUP);
+            fd->notify(failed || (event.events & (EPOLLIN | EPOLLRDHUP)), failed || (event.events & EPOLLOUT));
+        }
+    }
+    _ready = 0;
+}
+
+void Reactor::wake()
+{
+    uint64_t value = 1;
+    [[maybe_unused]] auto result = ::write(_wakeup, &value, sizeof(value));
+}
+
+ReactorStats Reactor::stats() const
+{
+    ReactorStats stats;
+    stats.syscalls = _syscalls.load(std::memory_order_relaxed);
+    stats.completions = _completions.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void Reactor::add(PollableFd *fd)
+{
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = fd;
+    bump(_syscalls);
+    if (epoll_ctl(_epoll, EPOLL_CTL_ADD, fd->fd(), &event) < 0) {
+        throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+    }
+    ++_size;
+}
+
+void Reactor::remove(PollableFd *fd)
+{
+    bump(_syscalls);
+    epoll_ctl(_epoll, EPOLL_CTL_DEL, fd->fd(), nullptr);
+    --_size;
+
+    // the descriptor may still be in the batch being dispatched
+    for (int n = 0; n < _ready; ++n) {
+        if (_events[n].data.ptr == fd) {
+            _events[n].data.ptr = nullptr;
+        }
+    }
+}
+
+#endif
+
+#if defined(BPROMISE_HAS_IO_URING)
+
+// The epoll instance (registered descriptors and the wakeup eventfd) is
+// watched by a multishot poll, so a single io_uring_enter() waits for both.
+void Reactor::watch_epoll()
+{
+    uint64_t syscalls = 0;
+    auto sqe = _uring->next(epoll_request, syscalls);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = _epoll;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    _syscalls.fetch_add(syscalls, std::memory_order_relaxed);
+}
+
+void Reactor::dispatch_uring()
+{
+    bool epoll_ready = false;
+
+    auto count = _uring->reap([this, &epoll_ready](uint64_t user_data, int result, uint32_t flags) {
+        bool more = flags & IORING_CQE_F_MORE;
+
+        if (user_data == ignored_request) {
+            return;
+        }
+
+        if (user_data == epoll_request) {
+            epoll_ready = true;
+            if (!more && !_stopping) {
+                watch_epoll();
+            }
+            return;
+        }
+
+        if (!more) {
+            --_inflight;
+        }
+
+        const char *buffer = nullptr;
+        unsigned id = flags >> IORING_CQE_BUFFER_SHIFT;
+        if (flags & IORING_CQE_F_BUFFER) {
+            buffer = _uring->buffer(id);
+        }
+
+        reinterpret_cast<IoCompletion*>(user_data)->complete(result, more, buffer);
+
+        if (buffer) {
+            _uring->recycle(id);
+        }
+    });
+    _completions.fetch_add(count, std::memory_order_relaxed);
+
+    if (epoll_ready) {
+        poll_epoll(0);
+        dispatch_epoll();
+    }
+}
+
+void Reactor::drain()
+{
+    if (!_uring || _inflight == 0) {
+        return;
+    }
+    _stopping = true;
+
+    // without IORING_ASYNC_CANCEL_ANY (5.19) the requests are only waited for
+    uint64_t syscalls = 0;
+    auto sqe = _uring->next(ignored_request, syscalls);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+#if defined(IORING_ASYNC_CANCEL_ANY)
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+#endif
+    _syscalls.fetch_add(syscalls, std::memory_order_relaxed);
+
+    auto deadline = std::chrono::steady_clock::now() + drain_timeout;
+    for (auto now = std::chrono::steady_clock::now(); _inflight > 0 && now < deadline; now = std::chrono::steady_clock::now()) {
+        auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now).count();
+        __kernel_timespec timeout{};
+        timeout.tv_sec = left / 1000000000;
+        timeout.tv_nsec = left % 1000000000;
+
+        bump(_syscalls);
+        _uring->enter(1, &timeout);
+        dispatch_uring();
+    }
+}
+
+void Reactor::submit_accept(int fd, IoCompletion *completion)
+{
+    uint64_t syscalls = 0;
+    auto sqe = _uring->next(reinterpret_cast<uint64_t>(completion), syscalls);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    if (_multishot) {
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    }
+    _syscalls.fetch_add(syscalls, std::memory_order_relaxed);
+    ++_inflight;
+}
+
+void Reactor::submit_recv(int fd, char *buffer, size_t size, IoCompletion *completion)
+{
+    uint64_t syscalls = 0;
+    auto sqe = _uring->next(reinterpret_cast<uint64_t>(completion), syscalls);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = static_cast<uint32_t>(size);
+    _syscalls.fetch_add(syscalls, std::memory_order_relaxed);
+    ++_inflight;
+}
+
+void Reactor::submit_recv_multishot(int fd, IoCompletion *completion)
+{
+    uint64_t syscalls = 0;
+    auto sqe = _uring->next(reinterpret_cast<uint64_t>(completion), syscalls);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = Uring::buffer_group;
+    _syscalls.fetch_add(syscalls, std::memory_order_relaxed);
+    ++_inflight;
+}
+
+void Reactor::submit_send(int fd, const char *data, size_t size, IoCompletion *completion)
+{
+    uint64_t syscalls = 0;
+    auto sqe = _uring->next(reinterpret_cast<uint64_t>(completion), syscalls);
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = static_cast<uint32_t>(size);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    _syscalls.fetch_add(syscalls, std::memory_order_relaxed);
+    ++_inflight;
+}
+
+void Reactor::submit_sendmsg(int fd, const msghdr *message, IoCompletion *completion)
+{
+    uint64_t syscalls = 0;
+    auto sqe = _uring->next(reinterpret_cast<uint64_t>(completion), syscalls);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(message);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    _syscalls.fetch_add(syscalls, std::memory_order_relaxed);
+    ++_inflight;
+}
+
+void Reactor::submit_close(int fd, IoCompletion *completion)
+{
+    uint64_t syscalls = 0;
+    auto sqe = _uring->next(reinterpret_cast<uint64_t>(completion), syscalls);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    _syscalls.fetch_add(syscalls, std::memory_order_relaxed);
+    ++_inflight;
+}
+
+void Reactor::submit_read(int fd, char *buffer, size_t size, uint64_t offset, IoCompletion *completion)
+{
+    uint64_t syscalls = 0;
+    auto sqe = _uring->next(reinterpret_cast<uint64_t>(completion), syscalls);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = static_cast<uint32_t>(size);
+    sqe->off = offset;
+    _syscalls.fetch_add(syscalls, std::memory_order_relaxed);
+    ++_inflight;
+}
+
+void Reactor::submit_write(int fd, const char *data, size_t size, uint64_t offset, IoCompletion *completion)
+{
+    uint64_t syscalls = 0;
+    auto sqe = _uring->next(reinterpret_cast<uint64_t>(completion), syscalls);
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = static_cast<uint32_t>(size);
+    sqe->off = offset;
+    _syscalls.fetch_add(syscalls, std::memory_order_relaxed);
+    ++_inflight;
+}
+
+void Reactor::submit_fsync(int fd, bool data_only, IoCompletion *completion)
+{
+    uint64_t syscalls = 0;
+    auto sqe = _uring->next(reinterpret_cast<uint64_t>(completion), syscalls);
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->fd = fd;
+    sqe->fsync_flags = data_only ? IORING_FSYNC_DATASYNC : 0;
+    _syscalls.fetch_add(syscalls, std::memory_order_relaxed);
+    ++_inflight;
+}
+
+// Single-shot: completes with the ready events, like a level-triggered poll()
+void Reactor::submit_poll(int fd, unsigned events, IoCompletion *completion)
+{
+    uint64_t syscalls = 0;
+    auto sqe = _uring->next(reinterpret_cast<uint64_t>(completion), syscalls);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    _syscalls.fetch_add(syscalls, std::memory_order_relaxed);
+    ++_inflight;
+}
+
+// The cancelled request still completes (with -ECANCELED) through its IoCompletion
+void Reactor::submit_cancel(IoCompletion *completion)
+{
+    uint64_t syscalls = 0;
+    auto sqe = _uring->next(ignored_request, syscalls);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = reinterpret_cast<uint64_t>(completion);
+    _syscalls.fetch_add(syscalls, std::memory_order_relaxed);
+}
+
+#endif
+
+#if !defined(BPROMISE_HAS_IO_URING)
+
+void Reactor::drain()
+{
+}
+
+#endif
+
+#if !defined(BPROMISE_HAS_EPOLL)
+
+Reactor::Reactor() = default;
+Reactor::~Reactor() = default;
+
+IoBackend Reactor::set_backend(IoBackend)
+{
+    return _backend;
+}
+
+void Reactor::wait(TimePoint deadline)
+{
+    // deferred waiters run right after this poll
+    if (!_deferred.empty()) {
+        deadline = TimePoint::min();
+    }
+
+    if (deadline == TimePoint::max()) {
+        _wait.wait();
+    } else if (deadline != TimePoint::min()) {
+        _wait.wait_until(deadline);
+    }
+}
+
+void Reactor::dispatch()
+{
+    run_deferred();
+}
+
+void Reactor::wake()
+{
+    _wait.signal();
+}
+
+ReactorStats Reactor::stats() const
+{
+    ReactorStats stats;
+    stats.syscalls = _syscalls.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void Reactor::add(PollableFd*)
+{
+    ++_size;
+}
+
+void Reactor::remove(PollableFd*)
+{
+    --_size;
+}
+
+#endif
+
+}
\ No newline at end of file
@@ -0,0 +1,39 @@
+#include "bpromise/semaphore.h"
+
+namespace BPromise
+{
+
+Future<> Semaphore::wait(size_t units)
+{
+    if (try_wait(units)) {
+        return make_ready_future<>();
+    }
+
+    _waiters.push_back(Waiter{units, Promise<>()});
+    return _waiters.back().promise.get_future();
+}
+
+bool Semaphore::try_wait(size_t units)
+{
+    if (!_waiters.empty() || _count < units) {
+        return false;
+    }
+
+    _count -= units;
+    return true;
+}
+
+void Semaphore::signal(size_t units)
+{
+    _count += units;
+
+    // continuations may wait or signal again, so each waiter leaves the queue first
+    while (!_waiters.empty() && _waiters.front().units <= _count) {
+        _count -= _waiters.front().units;
+        auto promise = std::move(_waiters.front().promise);
+        _waiters.pop_front();
+        promise.set_value();
+    }
+}
+
+}
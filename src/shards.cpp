@@ -0,0 +1,61 @@
+#include "bpromise/shards.h"
+#include <algorithm>
+
+#if defined(__linux__)
+#   include <pthread.h>
+#   include <sched.h>
+#endif
+
+namespace BPromise
+{
+
+std::vector<std::unique_ptr<Shards::Shard>> Shards::_shards;
+
+Shards::Shard::Shard(size_t index, IoBackend backend, bool pin)
+{
+    scheduler.reactor().set_backend(backend);
+
+    thread = std::thread([this, index]() {
+        BPROMISE_TRACE_THREAD("shard-" + std::to_string(index));
+        _current = index;
+        scheduler.run();
+        _current = npos;
+    });
+
+#if defined(__linux__)
+    if (pin) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(index % std::max(1u, std::thread::hardware_concurrency()), &cpus);
+        pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus);
+    }
+#else
+    (void)pin;
+#endif
+}
+
+void Shards::start(size_t count, IoBackend backend, bool pin)
+{
+    if (count == 0) {
+        count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t n = 0; n < count; ++n) {
+        _shards.emplace_back(std::make_unique<Shard>(n, backend, pin));
+    }
+}
+
+void Shards::stop()
+{
+    for (auto& shard : _shards) {
+        shard->scheduler.stop();
+    }
+
+    for (auto& shard : _shards) {
+        shard->thread.join();
+    }
+
+    _shards.clear();
+}
+
+}
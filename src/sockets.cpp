@@ -1,5 +1,7 @@
 #include "bpromise/sockets.h"
 #include "bpromise/threadpool.h"
+#include <algorithm>
+#include <deque>
 
 #if defined(_WIN32)
 #   define IS_WIN
@@ -7,13 +9,1126 @@
     static int close(SOCKET s) { return closesocket(s); }
 #elif defined(unix) || defined(__unix__) || defined(__unix)
 #   include <netinet/in.h>
+#   include <sys/uio.h>
 #   include <unistd.h>
+#   include <cerrno>
 #   define IS_UNIX
 #endif
 
+#if defined(BPROMISE_HAS_EPOLL)
+#   include <sys/sendfile.h>
+#endif
+
+#if defined(BPROMISE_HAS_IO_URING)
+#   include <poll.h>
+#endif
+
 namespace BPromise
 {
 
+// Size of the next receive buffer, following how much the previous reads returned
+struct ReadSize
+{
+    size_t min = 1024;
+    size_t max = 64 * 1024;
+    size_t next = 4096;
+
+    void set(size_t min_size, size_t max_size)
+    {
+        min = std::max<size_t>(min_size, 1);
+        max = std::max(min, max_size);
+        next = std::clamp(next, min, max);
+    }
+
+    // After `received` bytes were read into a buffer of `next` bytes
+    void update(size_t received)
+    {
+        if (received == next) {
+            next = std::min(next * 2, max);
+        } else if (received < next / 2) {
+            next = std::max(next / 2, min);
+        }
+    }
+};
+
+#if defined(BPROMISE_HAS_EPOLL)
+
+// Backend part of a ConnectedSocket
+struct SocketIo
+{
+    virtual ~SocketIo() = default;
+
+    virtual BPromise::Future<int, TemporaryBuffer> read() = 0;
+    virtual BPromise::Future<int> send(TemporaryBuffer data) = 0;
+    virtual BPromise::Future<int> send(std::vector<TemporaryBuffer> buffers) = 0;
+    virtual BPromise::Future<size_t> send_file(int fd, uint64_t offset, size_t length) = 0;
+
+    // Closes the descriptor and destroys the object, once no request is in flight anymore
+    virtual BPromise::Future<> close() = 0;
+
+    ReadSize read_size;
+};
+
+// Backend part of a ServerSocket
+struct ListenerIo
+{
+    virtual ~ListenerIo() = default;
+
+    virtual BPromise::Future<ConnectedSocket> accept() = 0;
+
+    // Same as SocketIo::close(), pending accepts are dropped
+    virtual void close() = 0;
+
+protected:
+    static ConnectedSocket connected(SOCKET socket, int port) { return ConnectedSocket(socket, port); }
+};
+
+// Sends in call order. The unsent data of consecutive sends goes out together,
+// one iovec per buffer; a send resolves once its last buffer is written.
+// File sends are queued in order too, the backend sends them with
+// send_file_part() once they reach the front.
+class WriteQueue
+{
+public:
+    static constexpr size_t max_iov = 64;
+
+    struct FileSend
+    {
+        int fd;
+        off_t offset;
+        size_t left;
+        size_t sent = 0;
+        BPromise::Promise<size_t> promise;
+    };
+
+    ~WriteQueue() { fail(); }
+
+    bool empty() const { return _entries.empty(); }
+
+    // Sends without data resolve right away
+    BPromise::Future<int> push(TemporaryBuffer data)
+    {
+        if (data.empty()) {
+            return BPromise::make_ready_future<int>(0);
+        }
+
+        BPromise::Promise<int> promise;
+        auto future = promise.get_future();
+
+        auto size = static_cast<int>(data.size());
+        _entries.push_back({std::move(data), size, true, std::move(promise)});
+
+        return future;
+    }
+
+    BPromise::Future<int> push(std::vector<TemporaryBuffer> buffers)
+    {
+        size_t size = 0;
+        for (auto& buffer : buffers) {
+            size += buffer.size();
+        }
+
+        if (size == 0) {
+            return BPromise::make_ready_future<int>(0);
+        }
+
+        auto last = std::move(buffers.back());
+        buffers.pop_back();
+        for (auto& buffer : buffers) {
+            if (!buffer.empty()) {
+                _entries.push_back({std::move(buffer), 0, false, BPromise::Promise<int>()});
+            }
+        }
+
+        BPromise::Promise<int> promise;
+        auto future = promise.get_future();
+        _entries.push_back({std::move(last), static_cast<int>(size), true, std::move(promise)});
+
+        return future;
+    }
+
+    BPromise::Future<size_t> push_file(int fd, uint64_t offset, size_t length)
+    {
+        if (length == 0) {
+            return BPromise::make_ready_future<size_t>(0);
+        }
+
+        auto file = std::make_unique<FileSend>();
+        file->fd = fd;
+        file->offset = static_cast<off_t>(offset);
+        file->left = length;
+        auto future = file->promise.get_future();
+
+        _entries.push_back({TemporaryBuffer(), 0, false, BPromise::Promise<int>(), std::move(file)});
+
+        return future;
+    }
+
+    FileSend* front_file() const
+    {
+        return _entries.empty() ? nullptr : _entries.front().file.get();
+    }
+
+    std::unique_ptr<FileSend> pop_file()
+    {
+        auto file = std::move(_entries.front().file);
+        _entries.pop_front();
+        return file;
+    }
+
+    // Points iov at the unsent data up to the next file, returns the iovec count
+    size_t gather(iovec *iov) const
+    {
+        size_t count = 0;
+        for (auto& entry : _entries) {
+            if (count == max_iov || entry.file) {
+                break;
+            }
+            if (!entry.data.empty()) {
+                iov[count].iov_base = const_cast<char*>(entry.data.get());
+                iov[count].iov_len = entry.data.size();
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    // Drops `sent` bytes from the front
+    void consume(size_t sent)
+    {
+        for (auto& entry : _entries) {
+            if (sent == 0) {
+                break;
+            }
+            auto size = std::min(sent, entry.data.size());
+            entry.data.trim_front(size);
+            sent -= size;
+        }
+    }
+
+    // Takes the first send if all of its data is written
+    bool pop_done(BPromise::Promise<int> &promise, int &size)
+    {
+        while (!_entries.empty() && _entries.front().data.empty() && !_entries.front().file) {
+            auto entry = std::move(_entries.front());
+            _entries.pop_front();
+            if (entry.last) {
+                promise = std::move(entry.promise);
+                size = entry.size;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Drops the first send, after an error
+    BPromise::Promise<int> pop_failed()
+    {
+        while (!_entries.empty()) {
+            auto entry = std::move(_entries.front());
+            _entries.pop_front();
+            if (entry.last) {
+                return std::move(entry.promise);
+            }
+        }
+        return BPromise::Promise<int>();
+    }
+
+    // Resolves every send with -1, and files with what was sent of them.
+    // The data stays, a request in flight may still read it.
+    void fail()
+    {
+        for (auto& entry : _entries) {
+            if (entry.file) {
+                auto file = std::move(entry.file);
+                file->promise.set_value(file->sent);
+            }
+            if (entry.last) {
+                entry.last = false;
+                auto promise = std::move(entry.promise);
+                promise.set_value(-1);
+            }
+        }
+    }
+
+private:
+    struct Entry
+    {
+        TemporaryBuffer data;
+        int size;  // of the whole send, on its last buffer
+        bool last;
+        BPromise::Promise<int> promise;
+        std::unique_ptr<FileSend> file = nullptr; // a file send instead of data
+    };
+
+    std::deque<Entry> _entries;
+};
+
+static bool would_block()
+{
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+enum class FileStep
+{
+    Done,    // sent, or failed (short of the length)
+    Yield,   // the slice is used up, the rest goes after other work ran
+    Blocked, // wait until the socket is writable
+};
+
+// At most this much of a file is sent before the socket yields to the others
+static constexpr size_t file_slice = 1024 * 1024;
+
+// The kernel copies from the page cache to the socket without a trip through user space
+static FileStep send_file_part(Reactor &reactor, int socket, WriteQueue::FileSend &file)
+{
+    size_t budget = file_slice;
+    while (file.left > 0 && budget > 0) {
+        reactor.count_syscall();
+        ssize_t result;
+        {
+            BPROMISE_TRACE_SCOPE("socket", "sendfile");
+            result = ::sendfile(socket, file.fd, &file.offset, std::min(file.left, budget));
+        }
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result < 0 && would_block()) {
+            return FileStep::Blocked;
+        }
+
+        // 0: the file ended before the length
+        if (result <= 0) {
+            return FileStep::Done;
+        }
+
+        file.sent += result;
+        file.left -= result;
+        budget -= result;
+    }
+
+    return file.left == 0 ? FileStep::Done : FileStep::Yield;
+}
+
+class EpollSocket : public SocketIo, public PollableFd
+{
+public:
+    using PollableFd::PollableFd;
+
+    BPromise::Future<int, TemporaryBuffer> read() override
+    {
+        BPromise::Promise<int, TemporaryBuffer> promise;
+        auto future = promise.get_future();
+
+        read_some(this, std::move(promise), TemporaryBuffer());
+
+        return future;
+    }
+
+    BPromise::Future<int> send(TemporaryBuffer data) override
+    {
+        return queue(std::move(data));
+    }
+
+    BPromise::Future<int> send(std::vector<TemporaryBuffer> buffers) override
+    {
+        return queue(std::move(buffers));
+    }
+
+    BPromise::Future<size_t> send_file(int fd, uint64_t offset, size_t length) override
+    {
+        bool idle = _writes.empty();
+        auto future = _writes.push_file(fd, offset, length);
+        if (idle && !_writes.empty()) {
+            flush_writes(this);
+        }
+        return future;
+    }
+
+    BPromise::Future<> close() override
+    {
+        fail_waiters();
+
+        auto socket = fd();
+        auto& reactor = this->reactor();
+        delete this;
+
+        reactor.count_syscall();
+        ::close(socket);
+
+        return BPromise::make_ready_future<>();
+    }
+
+private:
+    template <typename T>
+    BPromise::Future<int> queue(T data)
+    {
+        bool idle = _writes.empty();
+        auto future = _writes.push(std::move(data));
+        if (idle) {
+            flush_writes(this);
+        }
+        return future;
+    }
+
+    // The buffer is kept while waiting for data
+    static void read_some(EpollSocket *io, Promise<int, TemporaryBuffer> promise, TemporaryBuffer buffer)
+    {
+        if (io->closed()) {
+            promise.set_value(-1, TemporaryBuffer());
+            return;
+        }
+
+        if (buffer.empty()) {
+            buffer = TemporaryBuffer(io->read_size.next);
+        }
+
+        int result;
+        do {
+            io->reactor().count_syscall();
+            BPROMISE_TRACE_SCOPE("socket", "recv");
+            result = ::recv(io->fd(), buffer.get_write(), buffer.size(), 0);
+        } while (result < 0 && errno == EINTR);
+
+        if (result < 0 && would_block()) {
+            io->when_readable([io, promise = std::move(promise), buffer = std::move(buffer)]() mutable {
+                read_some(io, std::move(promise), std::move(buffer));
+            });
+            return;
+        }
+
+        if (result > 0) {
+            io->read_size.update(result);
+            buffer.trim(result);
+        } else {
+            buffer = TemporaryBuffer();
+        }
+        promise.set_value(result, std::move(buffer));
+    }
+
+    static void flush_writes(EpollSocket *io)
+    {
+        PollableFd::Guard guard(*io);
+
+        while (guard.alive() && !io->_writes.empty()) {
+            if (auto file = io->_writes.front_file()) {
+                auto step = send_file_part(io->reactor(), io->fd(), *file);
+                if (step != FileStep::Done) {
+                    auto resume = [io]() {
+                        if (!io->closed()) {
+                            flush_writes(io);
+                        }
+                    };
+                    if (step == FileStep::Blocked) {
+                        io->when_writable(std::move(resume));
+                    } else {
+                        io->defer(std::move(resume));
+                    }
+                    return;
+                }
+
+                auto done = io->_writes.pop_file();
+                done->promise.set_value(done->sent);
+                continue;
+            }
+
+            iovec iov[WriteQueue::max_iov];
+            msghdr message{};
+            message.msg_iov = iov;
+            message.msg_iovlen = io->_writes.gather(iov);
+
+            io->reactor().count_syscall();
+            ssize_t result;
+            {
+                BPROMISE_TRACE_SCOPE("socket", "sendmsg");
+                result = ::sendmsg(io->fd(), &message, MSG_NOSIGNAL);
+            }
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+
+            if (result < 0 && would_block()) {
+                io->when_writable([io]() {
+                    if (!io->closed()) {
+                        flush_writes(io);
+                    }
+                });
+                return;
+            }
+
+            // continuations may start new sends or close the socket
+            if (result < 0) {
+                auto promise = io->_writes.pop_failed();
+                promise.set_value(-1);
+                continue;
+            }
+
+            io->_writes.consume(result);
+
+            BPromise::Promise<int> promise;
+            int size;
+            while (guard.alive() && io->_writes.pop_done(promise, size)) {
+                promise.set_value(size);
+            }
+        }
+    }
+
+private:
+    WriteQueue _writes;
+};
+
+// Out of descriptors or memory: the pending connections stay in the backlog
+// and bring no new readiness edge, so accept() tries again after this long
+static constexpr auto accept_retry_delay = std::chrono::milliseconds(100);
+
+static bool out_of_resources(int error)
+{
+    return error == EMFILE || error == ENFILE || error == ENOBUFS || error == ENOMEM;
+}
+
+class EpollListener : public ListenerIo, public PollableFd
+{
+public:
+    EpollListener(Reactor &reactor, SOCKET socket) :
+        PollableFd(reactor, socket),
+        _scheduler(this_scheduler())
+    {
+    }
+
+    BPromise::Future<ConnectedSocket> accept() override
+    {
+        BPromise::Promise<ConnectedSocket> promise;
+        auto future = promise.get_future();
+
+        accept_one(this, std::move(promise));
+
+        return future;
+    }
+
+    void close() override
+    {
+        // waiters still parked resolve with empty sockets
+        fail_waiters();
+
+        if (_retry) {
+            _scheduler.clear_timer(_retry);
+        }
+        auto retrying = std::move(_retrying);
+
+        auto socket = fd();
+        delete this;
+        ::close(socket);
+
+        for (auto& promise : retrying) {
+            promise.set_value(ConnectedSocket());
+        }
+    }
+
+private:
+    static void accept_one(EpollListener *io, Promise<ConnectedSocket> promise)
+    {
+        if (io->closed()) {
+            promise.set_value(ConnectedSocket());
+            return;
+        }
+
+        sockaddr_in clientAddr;
+        socklen_t clientAddrSize = sizeof(sockaddr_in);
+        SOCKET clientSocket;
+        do {
+            io->reactor().count_syscall();
+            BPROMISE_TRACE_SCOPE("socket", "accept4");
+            clientSocket = ::accept4(io->fd(), (sockaddr*)&clientAddr, &clientAddrSize, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        } while (clientSocket == -1 && (errno == EINTR || errno == ECONNABORTED));
+
+        if (clientSocket == -1 && would_block()) {
+            io->when_readable([io, promise = std::move(promise)]() mutable {
+                accept_one(io, std::move(promise));
+            });
+            return;
+        }
+
+        if (clientSocket == -1 && out_of_resources(errno)) {
+            io->retry_later(std::move(promise));
+            return;
+        }
+
+        if (clientSocket == -1) {
+            promise.set_value(ConnectedSocket());
+            return;
+        }
+
+        promise.set_value(connected(clientSocket, clientAddr.sin_port));
+    }
+
+    void retry_later(Promise<ConnectedSocket> promise)
+    {
+        _retrying.push_back(std::move(promise));
+        if (_retry) {
+            return;
+        }
+
+        _retry = _scheduler.set_timeout(accept_retry_delay, [this]() {
+            _retry = 0;
+            auto retrying = std::move(_retrying);
+            _retrying.clear();
+
+            // a continuation may close the server socket
+            PollableFd::Guard guard(*this);
+            for (auto& promise : retrying) {
+                if (guard.alive()) {
+                    accept_one(this, std::move(promise));
+                } else {
+                    promise.set_value(ConnectedSocket());
+                }
+            }
+        });
+    }
+
+private:
+    Scheduler &_scheduler;
+    TimerId _retry = 0;
+    std::deque<Promise<ConnectedSocket>> _retrying;
+};
+
+#if defined(BPROMISE_HAS_IO_URING)
+
+// Routes the completions of one kind of request to a member function
+template <typename T, void (T::*Handler)(int, bool, const char*)>
+struct MemberCompletion final : IoCompletion
+{
+    explicit MemberCompletion(T *owner) : owner(owner) {}
+
+    void complete(int result, bool more, const char *buffer) override
+    {
+        (owner->*Handler)(result, more, buffer);
+    }
+
+    T *owner;
+};
+
+// With multishot support the socket keeps receiving into the reactor's
+// provided buffers and queues the data until read() asks for it; otherwise
+// a single recv is in flight while a reader waits. Sends go out one at a time
+// in call order. Everything is submitted with the next reactor wait().
+class UringSocket : public SocketIo
+{
+public:
+    // receiving ahead stops once this much data waits for read()
+    static constexpr size_t max_buffered = 64 * 1024;
+
+    UringSocket(Reactor &reactor, SOCKET socket) :
+        _reactor(reactor),
+        _socket(socket)
+    {
+    }
+
+    BPromise::Future<int, TemporaryBuffer> read() override
+    {
+        if (!_received.empty()) {
+            auto data = std::move(_received.front());
+            _received.pop_front();
+            _buffered -= data.size();
+            receive();
+
+            int size = static_cast<int>(data.size());
+            return BPromise::make_ready_future<int, TemporaryBuffer>(size, std::move(data));
+        }
+
+        if (_finished) {
+            return BPromise::make_ready_future<int, TemporaryBuffer>(_finish_result, TemporaryBuffer());
+        }
+
+        BPromise::Promise<int, TemporaryBuffer> promise;
+        auto future = promise.get_future();
+
+        _readers.push_back(std::move(promise));
+        receive();
+
+        return future;
+    }
+
+    BPromise::Future<int> send(TemporaryBuffer data) override
+    {
+        return queue(std::move(data));
+    }
+
+    BPromise::Future<int> send(std::vector<TemporaryBuffer> buffers) override
+    {
+        return queue(std::move(buffers));
+    }
+
+    BPromise::Future<size_t> send_file(int fd, uint64_t offset, size_t length) override
+    {
+        auto future = _writes.push_file(fd, offset, length);
+        if (!_sending) {
+            send_next();
+        }
+        return future;
+    }
+
+    BPromise::Future<> close() override
+    {
+        _closing = true;
+
+        BPromise::Promise<> promise;
+        auto future = promise.get_future();
+        _closed = std::move(promise);
+
+        if (_receiving) {
+            _reactor.submit_cancel(&_receive);
+        }
+        if (_sending) {
+            // a file at the front is waiting for the socket to become writable
+            _reactor.submit_cancel(_writes.front_file() ? static_cast<IoCompletion*>(&_writable) : &_send);
+        }
+
+        // the data of a send in flight stays alive until its completion arrives
+        _writes.fail();
+
+        while (!_readers.empty()) {
+            auto promise = std::move(_readers.front());
+            _readers.pop_front();
+            promise.set_value(-1, TemporaryBuffer());
+        }
+
+        close_when_idle();
+        return future;
+    }
+
+private:
+    template <typename T>
+    BPromise::Future<int> queue(T data)
+    {
+        auto future = _writes.push(std::move(data));
+        if (!_sending) {
+            send_next();
+        }
+        return future;
+    }
+
+    void receive()
+    {
+        if (_receiving || _closing || _finished || _reactor.stopping()) {
+            return;
+        }
+
+        _multishot = _reactor.multishot();
+        if (_multishot) {
+            if (_buffered >= max_buffered) {
+                return;
+            }
+            _reactor.submit_recv_multishot(_socket, &_receive);
+        } else {
+            if (_readers.empty()) {
+                return;
+            }
+            // received into directly, the data is handed over without a copy
+            _buffer = TemporaryBuffer(read_size.next);
+            _reactor.submit_recv(_socket, _buffer.get_write(), _buffer.size(), &_receive);
+        }
+        _receiving = true;
+    }
+
+    void received(int result, bool more, const char *buffer)
+    {
+        if (!more) {
+            _receiving = false;
+            _cancelling = false;
+        }
+
+        if (_closing) {
+            close_when_idle();
+            return;
+        }
+
+        if (result > 0) {
+            TemporaryBuffer data;
+            if (buffer) {
+                // provided buffers go back to the reactor's ring
+                data = TemporaryBuffer(buffer, result);
+            } else {
+                read_size.update(result);
+                data = std::move(_buffer);
+                data.trim(result);
+            }
+
+            if (!_readers.empty()) {
+                auto promise = std::move(_readers.front());
+                _readers.pop_front();
+                promise.set_value(result, std::move(data));
+            } else {
+                _buffered += data.size();
+                _received.push_back(std::move(data));
+            }
+        } else if (result == -EINVAL && _multishot) {
+            // multishot recv needs Linux 6.0
+            _reactor.disable_multishot();
+        } else if (result != -ENOBUFS && result != -ECANCELED) {
+            finish(result == 0 ? 0 : -1);
+        }
+
+        // a continuation may have closed the socket
+        if (_closing) {
+            close_when_idle();
+            return;
+        }
+
+        if (_receiving && _buffered >= max_buffered && !_cancelling) {
+            _cancelling = true;
+            _reactor.submit_cancel(&_receive);
+        }
+
+        receive();
+    }
+
+    void finish(int result)
+    {
+        _finished = true;
+        _finish_result = result;
+
+        while (!_readers.empty()) {
+            auto promise = std::move(_readers.front());
+            _readers.pop_front();
+            promise.set_value(result, TemporaryBuffer());
+        }
+    }
+
+    void send_next()
+    {
+        if (_writes.empty() || _closing || _reactor.stopping()) {
+            return;
+        }
+
+        // sendfile() runs inline once a poll finds the socket writable, one slice
+        // per poll: io_uring has no direct equivalent
+        if (_writes.front_file()) {
+            _sending = true;
+            _reactor.submit_poll(_socket, POLLOUT, &_writable);
+            return;
+        }
+
+        auto count = _writes.gather(_iov);
+        if (count == 0) {
+            return;
+        }
+
+        _message = msghdr{};
+        _message.msg_iov = _iov;
+        _message.msg_iovlen = count;
+        _sending = true;
+        _reactor.submit_sendmsg(_socket, &_message, &_send);
+    }
+
+    void sent(int result, bool, const char*)
+    {
+        _sending = false;
+
+        if (_closing) {
+            close_when_idle();
+            return;
+        }
+
+        // continuations may start new sends or close the socket
+        if (result < 0) {
+            auto promise = _writes.pop_failed();
+            send_next();
+            promise.set_value(-1);
+            return;
+        }
+
+        _writes.consume(result);
+
+        // what is left goes out before the continuations run
+        BPromise::Promise<int> promise;
+        int size;
+        bool done = _writes.pop_done(promise, size);
+        send_next();
+        while (done) {
+            promise.set_value(size);
+            done = !_closing && _writes.pop_done(promise, size);
+        }
+    }
+
+    void writable(int result, bool, const char*)
+    {
+        _sending = false;
+
+        if (_closing) {
+            close_when_idle();
+            return;
+        }
+
+        auto file = _writes.front_file();
+        if (result >= 0 && send_file_part(_reactor, _socket, *file) != FileStep::Done) {
+            _sending = true;
+            _reactor.submit_poll(_socket, POLLOUT, &_writable);
+            return;
+        }
+
+        auto done = _writes.pop_file();
+        send_next();
+        done->promise.set_value(done->sent);
+    }
+
+    void close_when_idle()
+    {
+        if (!_receiving && !_sending && !_close_submitted) {
+            _close_submitted = true;
+            _reactor.submit_close(_socket, &_close);
+        }
+    }
+
+    void closed(int, bool, const char*)
+    {
+        auto promise = std::move(_closed);
+        delete this;
+        promise.set_value();
+    }
+
+private:
+    Reactor &_reactor;
+    SOCKET _socket;
+
+    MemberCompletion<UringSocket, &UringSocket::received> _receive{this};
+    MemberCompletion<UringSocket, &UringSocket::sent> _send{this};
+    MemberCompletion<UringSocket, &UringSocket::writable> _writable{this};
+    MemberCompletion<UringSocket, &UringSocket::closed> _close{this};
+
+    bool _receiving = false;
+    bool _multishot = false;
+    bool _cancelling = false;
+    bool _sending = false;
+    bool _closing = false;
+    bool _close_submitted = false;
+    bool _finished = false;
+    int _finish_result = 0;
+
+    std::deque<TemporaryBuffer> _received;
+    size_t _buffered = 0;
+    std::deque<Promise<int, TemporaryBuffer>> _readers;
+    WriteQueue _writes;
+    iovec _iov[WriteQueue::max_iov];
+    msghdr _message;
+    BPromise::Promise<> _closed;
+    TemporaryBuffer _buffer;
+};
+
+// Keeps one (multishot when supported) accept in flight once accept() was called;
+// connections accepted ahead of accept() calls are queued.
+class UringListener : public ListenerIo
+{
+public:
+    UringListener(Reactor &reactor, SOCKET socket) :
+        _reactor(reactor),
+        _scheduler(this_scheduler()),
+        _socket(socket)
+    {
+    }
+
+    BPromise::Future<ConnectedSocket> accept() override
+    {
+        if (!_accepted.empty()) {
+            auto socket = _accepted.front();
+            _accepted.pop_front();
+            return BPromise::make_ready_future<ConnectedSocket>(accepted(socket));
+        }
+
+        BPromise::Promise<ConnectedSocket> promise;
+        auto future = promise.get_future();
+
+        _waiting.push_back(std::move(promise));
+        start();
+
+        return future;
+    }
+
+    void close() override
+    {
+        _closing = true;
+        if (_accepting) {
+            _reactor.submit_cancel(&_accept);
+        }
+        if (_retry) {
+            _scheduler.clear_timer(_retry);
+            _retry = 0;
+        }
+
+        for (auto socket : _accepted) {
+            _reactor.count_syscall();
+            ::close(socket);
+        }
+        _accepted.clear();
+
+        auto waiting = std::move(_waiting);
+        _waiting.clear();
+
+        close_when_idle();
+
+        for (auto& promise : waiting) {
+            promise.set_value(ConnectedSocket());
+        }
+    }
+
+private:
+    void start()
+    {
+        if (_accepting || _closing || _retry || _reactor.stopping() || (!_reactor.multishot() && _waiting.empty())) {
+            return;
+        }
+
+        _multishot = _reactor.multishot();
+        _accepting = true;
+        _reactor.submit_accept(_socket, &_accept);
+    }
+
+    ConnectedSocket accepted(SOCKET socket)
+    {
+        // multishot accept cannot report peer addresses
+        sockaddr_in clientAddr{};
+        socklen_t clientAddrSize = sizeof(sockaddr_in);
+        _reactor.count_syscall();
+        ::getpeername(socket, (sockaddr*)&clientAddr, &clientAddrSize);
+
+        return connected(socket, clientAddr.sin_port);
+    }
+
+    void on_accept(int result, bool more, const char*)
+    {
+        if (!more) {
+            _accepting = false;
+        }
+
+        if (_closing) {
+            if (result >= 0) {
+                _reactor.count_syscall();
+                ::close(result);
+            }
+            close_when_idle();
+            return;
+        }
+
+        if (result >= 0) {
+            if (!_waiting.empty()) {
+                auto promise = std::move(_waiting.front());
+                _waiting.pop_front();
+                promise.set_value(accepted(result));
+            } else {
+                _accepted.push_back(result);
+            }
+        } else if (result == -EINVAL && _multishot) {
+            _reactor.disable_multishot();
+        } else if (out_of_resources(-result)) {
+            // submitted again right away it would fail again
+            if (!_accepting && !_retry) {
+                _retry = _scheduler.set_timeout(accept_retry_delay, [this]() {
+                    _retry = 0;
+                    start();
+                });
+            }
+            return;
+        } else if (result != -EINTR && result != -ECONNABORTED && result != -ECANCELED) {
+            // not submitted again until the next accept()
+            auto waiting = std::move(_waiting);
+            _waiting.clear();
+            for (auto& promise : waiting) {
+                promise.set_value(ConnectedSocket());
+            }
+            if (_closing) {
+                close_when_idle();
+            }
+            return;
+        }
+
+        // a continuation may have destroyed the server socket
+        if (_closing) {
+            close_when_idle();
+            return;
+        }
+
+        start();
+    }
+
+    void close_when_idle()
+    {
+        if (!_accepting && !_close_submitted) {
+            _close_submitted = true;
+            _reactor.submit_close(_socket, &_close);
+        }
+    }
+
+    void on_close(int, bool, const char*)
+    {
+        delete this;
+    }
+
+private:
+    Reactor &_reactor;
+    Scheduler &_scheduler;
+    SOCKET _socket;
+
+    MemberCompletion<UringListener, &UringListener::on_accept> _accept{this};
+    MemberCompletion<UringListener, &UringListener::on_close> _close{this};
+
+    bool _accepting = false;
+    bool _multishot = false;
+    bool _closing = false;
+    bool _close_submitted = false;
+    TimerId _retry = 0;
+    std::deque<SOCKET> _accepted;
+    std::deque<Promise<ConnectedSocket>> _waiting;
+};
+
+#endif
+
+static std::unique_ptr<SocketIo> make_socket_io(SOCKET socket)
+{
+    auto& reactor = this_scheduler().reactor();
+#if defined(BPROMISE_HAS_IO_URING)
+    if (reactor.backend() == IoBackend::IoUring) {
+        return std::make_unique<UringSocket>(reactor, socket);
+    }
+#endif
+    return std::make_unique<EpollSocket>(reactor, socket);
+}
+
+static std::unique_ptr<ListenerIo> make_listener_io(SOCKET socket)
+{
+    auto& reactor = this_scheduler().reactor();
+#if defined(BPROMISE_HAS_IO_URING)
+    if (reactor.backend() == IoBackend::IoUring) {
+        return std::make_unique<UringListener>(reactor, socket);
+    }
+#endif
+    return std::make_unique<EpollListener>(reactor, socket);
+}
+
+#else
+
+struct SocketIo
+{
+    ReadSize read_size;
+};
+
+struct ListenerIo
+{
+};
+
+#endif
+
+ConnectedSocket::ConnectedSocket(SOCKET socket, int port) :
+    _socket(socket),
+    _port(port)
+{
+#if defined(BPROMISE_HAS_EPOLL)
+    _io = make_socket_io(_socket);
+#else
+    _io = std::make_unique<SocketIo>();
+#endif
+}
+
+ConnectedSocket::ConnectedSocket() = default;
+
 ConnectedSocket::~ConnectedSocket()
 {
     if (_socket) {
@@ -23,7 +1138,8 @@ ConnectedSocket::~ConnectedSocket()
 
 ConnectedSocket::ConnectedSocket(ConnectedSocket&& other) :
     _socket(other._socket),
-    _port(other._port)
+    _port(other._port),
+    _io(std::move(other._io))
 {
     other._socket = 0;
 }
@@ -31,23 +1147,71 @@ ConnectedSocket::ConnectedSocket(ConnectedSocket&& other) :
 ConnectedSocket& ConnectedSocket::operator=(ConnectedSocket&& other)
 {
     if (this != &other) {
+        if (_socket) {
+            close();
+        }
         _socket = other._socket;
-        _port = other._socket;
+        _port = other._port;
+        _io = std::move(other._io);
         other._socket = 0;
     }
     return *this;
 }
 
+#if defined(BPROMISE_HAS_EPOLL)
+
 BPromise::Future<> ConnectedSocket::close()
 {
-    auto promise = std::make_shared<BPromise::Promise<>>();
-    auto future = promise->get_future();
+    _socket = 0;
+    if (!_io) {
+        return BPromise::make_ready_future<>();
+    }
+
+    return _io.release()->close();
+}
+
+BPromise::Future<int> ConnectedSocket::send(TemporaryBuffer data)
+{
+    if (!_io) {
+        return BPromise::make_ready_future<int>(-1);
+    }
+
+    return _io->send(std::move(data));
+}
+
+BPromise::Future<int> ConnectedSocket::send(std::vector<TemporaryBuffer> buffers)
+{
+    if (!_io) {
+        return BPromise::make_ready_future<int>(-1);
+    }
+
+    return _io->send(std::move(buffers));
+}
+
+BPromise::Future<size_t> ConnectedSocket::send_file(int fd, uint64_t offset, size_t length)
+{
+    if (!_io) {
+        return BPromise::make_ready_future<size_t>(0);
+    }
+
+    return _io->send_file(fd, offset, length);
+}
 
-    BPromise::ThreadPool::set_immediate([socket = _socket, promise = std::move(promise)]() mutable {
+BPromise::Future<int, TemporaryBuffer> ConnectedSocket::read_buffer()
+{
+    if (!_io) {
+        return BPromise::make_ready_future<int, TemporaryBuffer>(-1, TemporaryBuffer());
+    }
+
+    return _io->read();
+}
+
+#else
+
+BPromise::Future<> ConnectedSocket::close()
+{
+    auto future = BPromise::ThreadPool::submit([socket = _socket]() {
         ::close(socket);
-        BPromise::MainThread::set_immediate([promise = std::move(promise)]() mutable {
-            promise->set_value();
-        });
     });
 
     _socket = 0;
@@ -55,46 +1219,122 @@ BPromise::Future<> ConnectedSocket::close()
     return future;
 }
 
-BPromise::Future<int> ConnectedSocket::send(std::string data)
+BPromise::Future<int> ConnectedSocket::send(TemporaryBuffer data)
 {
-    auto promise = std::make_shared<BPromise::Promise<int>>();
-    auto future = promise->get_future();
+    return BPromise::ThreadPool::submit([socket = _socket, data = std::move(data)]() {
+        BPROMISE_TRACE_SCOPE("socket", "send");
+        return static_cast<int>(::send(socket, data.get(), data.size(), 0));
+    });
+}
 
-    BPromise::ThreadPool::set_immediate([socket = _socket, data = std::move(data), promise = std::move(promise)]() mutable {
-        int result = ::send(socket, data.data(), data.size(), 0);
-        BPromise::MainThread::set_immediate([promise = std::move(promise), result]() mutable {
-            promise->set_value(result);
-        });
+BPromise::Future<int> ConnectedSocket::send(std::vector<TemporaryBuffer> buffers)
+{
+    return BPromise::ThreadPool::submit([socket = _socket, buffers = std::move(buffers)]() {
+        BPROMISE_TRACE_SCOPE("socket", "send");
+        int total = 0;
+        for (auto& buffer : buffers) {
+            size_t sent = 0;
+            while (sent < buffer.size()) {
+                auto result = ::send(socket, buffer.get() + sent, static_cast<int>(buffer.size() - sent), 0);
+                if (result < 0) {
+                    return -1;
+                }
+                sent += result;
+            }
+            total += static_cast<int>(sent);
+        }
+        return total;
     });
+}
 
-    return future;
+// Copied through a buffer, sendfile() differs among the platforms that have it
+BPromise::Future<size_t> ConnectedSocket::send_file(int fd, uint64_t offset, size_t length)
+{
+#if defined(IS_UNIX)
+    return BPromise::ThreadPool::submit([socket = _socket, fd, offset, length]() {
+        static constexpr size_t chunk = 64 * 1024;
+        TemporaryBuffer buffer(std::min(length, chunk));
+        size_t sent = 0;
+        while (sent < length) {
+            auto result = ::pread(fd, buffer.get_write(), std::min(length - sent, chunk), static_cast<off_t>(offset + sent));
+            if (result <= 0) {
+                break;
+            }
+            for (ssize_t written = 0; written < result;) {
+                auto size = ::send(socket, buffer.get() + written, result - written, 0);
+                if (size < 0) {
+                    return sent;
+                }
+                written += size;
+                sent += size;
+            }
+        }
+        return sent;
+    });
+#else
+    return BPromise::make_ready_future<size_t>(0);
+#endif
 }
 
-BPromise::Future<int, std::string> ConnectedSocket::read()
+BPromise::Future<int, TemporaryBuffer> ConnectedSocket::read_buffer()
 {
-    auto promise = std::make_shared<BPromise::Promise<int, std::string>>();
-    auto future = promise->get_future();
+    if (!_io) {
+        return BPromise::make_ready_future<int, TemporaryBuffer>(-1, TemporaryBuffer());
+    }
 
-    BPromise::ThreadPool::set_immediate([socket = _socket, promise = std::move(promise)]() mutable {
-        char buffer[1024];
-        int result = recv(socket, buffer, sizeof(buffer), 0);
-        std::string data(buffer, result ? result : 0);
-        BPromise::MainThread::set_immediate([promise = std::move(promise), result, data = std::move(data)]() mutable {
-            promise->set_value(result, std::move(data));
-        });
+    // blocking reads cannot adapt their size to what is pending
+    return BPromise::ThreadPool::submit([socket = _socket, size = _io->read_size.next]() {
+        BPROMISE_TRACE_SCOPE("socket", "recv");
+        TemporaryBuffer buffer(size);
+        int result = recv(socket, buffer.get_write(), static_cast<int>(size), 0);
+        buffer.trim(result > 0 ? result : 0);
+        return BPromise::make_ready_future<int, TemporaryBuffer>(result, std::move(buffer));
     });
+}
 
-    return future;
+#endif
+
+BPromise::Future<int> ConnectedSocket::send(std::string data)
+{
+    return send(TemporaryBuffer(std::move(data)));
+}
+
+BPromise::Future<int, std::string> ConnectedSocket::read()
+{
+    return read_buffer().then([](int result, TemporaryBuffer data) {
+        return BPromise::make_ready_future<int, std::string>(result, data.to_string());
+    });
 }
 
-ServerSocket::ServerSocket(int port)
+void ConnectedSocket::set_read_size(size_t min, size_t max)
+{
+    if (_io) {
+        _io->read_size.set(min, max);
+    }
+}
+
+ServerSocket::ServerSocket(int port, bool reuse_port)
 {
 #if defined(_WIN32)
     WSADATA WSAData;
     WSAStartup(MAKEWORD(2, 0), &WSAData);
 #endif
 
+#if defined(BPROMISE_HAS_EPOLL)
+    _socket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+#else
     _socket = socket(AF_INET, SOCK_STREAM, 0);
+#endif
+
+    int reuse = 1;
+    setsockopt(_socket, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+#if defined(SO_REUSEPORT)
+    if (reuse_port) {
+        setsockopt(_socket, SOL_SOCKET, SO_REUSEPORT, (const char*)&reuse, sizeof(reuse));
+    }
+#else
+    (void)reuse_port;
+#endif
 
     sockaddr_in serverAddr;
     serverAddr.sin_addr.s_addr = INADDR_ANY;
@@ -102,13 +1342,21 @@ ServerSocket::ServerSocket(int port)
     serverAddr.sin_port = htons(port);
 
     ::bind(_socket, (sockaddr*)&serverAddr, sizeof(serverAddr));
-    ::listen(_socket, 0);
+    ::listen(_socket, SOMAXCONN);
+
+#if defined(BPROMISE_HAS_EPOLL)
+    _io = make_listener_io(_socket);
+#endif
 }
 
 ServerSocket::~ServerSocket()
 {
     if (_socket) {
+#if defined(BPROMISE_HAS_EPOLL)
+        _io.release()->close();
+#else
         ::close(_socket);
+#endif
 
 #if defined(_WIN32)
         WSACleanup();
@@ -117,7 +1365,8 @@ ServerSocket::~ServerSocket()
 }
 
 ServerSocket::ServerSocket(ServerSocket&& other) :
-    _socket(other._socket)
+    _socket(other._socket),
+    _io(std::move(other._io))
 {
     other._socket = 0;
 }
@@ -125,30 +1374,58 @@ ServerSocket::ServerSocket(ServerSocket&& other) :
 ServerSocket & ServerSocket::operator=(ServerSocket&& other)
 {
     if (this != &other) {
+        if (_socket) {
+#if defined(BPROMISE_HAS_EPOLL)
+            _io.release()->close();
+#else
+            ::close(_socket);
+#endif
+        }
         _socket = other._socket;
+        _io = std::move(other._io);
         other._socket = 0;
     }
     return *this;
 }
 
+#if defined(BPROMISE_HAS_EPOLL)
+
 BPromise::Future<ConnectedSocket> ServerSocket::accept()
 {
-    auto promise = std::make_shared<BPromise::Promise<ConnectedSocket>>();
+    // e.g. from the continuation of an accept the closing resolved
+    if (!_io) {
+        return BPromise::make_ready_future<ConnectedSocket>(ConnectedSocket());
+    }
+
+    return _io->accept();
+}
+
+#else
+
+BPromise::Future<ConnectedSocket> ServerSocket::accept()
+{
+    auto promise = std::make_unique<BPromise::Promise<ConnectedSocket>>();
     auto future = promise->get_future();
 
-    BPromise::ThreadPool::set_immediate([socket = _socket, promise = std::move(promise)]() mutable {
+    BPromise::ThreadPool::set_immediate([socket = _socket, promise = std::move(promise), &origin = this_scheduler()]() mutable {
         sockaddr_in clientAddr;
         socklen_t clientAddrSize = sizeof(sockaddr_in);
         if (SOCKET clientSocket = ::accept(socket, (sockaddr*)&clientAddr, &clientAddrSize); clientSocket != -1)
         {
-            BPromise::MainThread::set_immediate([promise = std::move(promise), clientSocket, port = clientAddr.sin_port]() mutable {
+            origin.set_immediate([promise = std::move(promise), clientSocket, port = clientAddr.sin_port]() mutable {
                 ConnectedSocket client(clientSocket, port);
                 promise->set_value(std::move(client));
             });
+        } else {
+            origin.set_immediate([promise = std::move(promise)]() mutable {
+                promise->set_value(ConnectedSocket());
+            });
         }
     });
 
     return future;
 }
 
+#endif
+
 }
\ No newline at end of file
@@ -0,0 +1,323 @@
+#include "bpromise/stream.h"
+#include <cstring>
+
+namespace BPromise
+{
+
+OutputStream::OutputStream(ConnectedSocket &socket, size_t flush_size) :
+    _socket(socket),
+    _flush_size(flush_size)
+{
+}
+
+BPromise::Future<int> OutputStream::write(const char *data, size_t size)
+{
+    if (_failed) {
+        return BPromise::make_ready_future<int>(-1);
+    }
+
+    if (size > copy_threshold) {
+        return write(TemporaryBuffer(data, size));
+    }
+
+    if (chunk_size - _chunk_used < size) {
+        seal_chunk();
+        _chunk = TemporaryBuffer();
+    }
+
+    if (_chunk.empty()) {
+        _chunk = TemporaryBuffer(chunk_size);
+        _chunk_start = 0;
+        _chunk_used = 0;
+    }
+
+    std::memcpy(_chunk.get_write() + _chunk_used, data, size);
+    _chunk_used += size;
+    _pending_size += size;
+
+    return buffered(size);
+}
+
+BPromise::Future<int> OutputStream::write(std::string data)
+{
+    if (data.size() <= copy_threshold) {
+        return write(data.data(), data.size());
+    }
+
+    return write(TemporaryBuffer(std::move(data)));
+}
+
+BPromise::Future<int> OutputStream::write(TemporaryBuffer data)
+{
+    if (data.size() <= copy_threshold) {
+        return write(data.get(), data.size());
+    }
+
+    if (_failed) {
+        return BPromise::make_ready_future<int>(-1);
+    }
+
+    auto size = data.size();
+    seal_chunk();
+    _pending.push_back(std::move(data));
+    _pending_size += size;
+
+    return buffered(size);
+}
+
+BPromise::Future<int> OutputStream::flush()
+{
+    if (_failed) {
+        return BPromise::make_ready_future<int>(-1);
+    }
+
+    if (_pending_size == 0 && !_sending) {
+        return BPromise::make_ready_future<int>(0);
+    }
+
+    BPromise::Promise<int> promise;
+    auto future = promise.get_future();
+
+    _flush_waiters.push_back(std::move(promise));
+    if (!_sending) {
+        send_batch();
+    }
+
+    return future;
+}
+
+BPromise::Future<> OutputStream::close()
+{
+    return flush().then([this](int) {
+        return _socket.close();
+    });
+}
+
+// The rest of the chunk stays in use for the next writes
+void OutputStream::seal_chunk()
+{
+    if (_chunk_used > _chunk_start) {
+        _pending.push_back(_chunk.share(_chunk_start, _chunk_used - _chunk_start));
+        _chunk_start = _chunk_used;
+    }
+}
+
+BPromise::Future<int> OutputStream::buffered(size_t size)
+{
+    if (_pending_size < _flush_size) {
+        return BPromise::make_ready_future<int>(static_cast<int>(size));
+    }
+
+    return flush().then([size](int result) {
+        return result < 0 ? -1 : static_cast<int>(size);
+    });
+}
+
+void OutputStream::send_batch()
+{
+    seal_chunk();
+
+    auto buffers = std::move(_pending);
+    _pending.clear();
+    _pending_size = 0;
+
+    auto waiters = std::move(_flush_waiters);
+    _flush_waiters.clear();
+
+    _sending = true;
+    _socket.send(std::move(buffers)).then([this, waiters = std::move(waiters)](int result) mutable {
+        _sending = false;
+        if (result < 0) {
+            _failed = true;
+        }
+
+        // the stream may be gone once the waiters ran
+        if (_failed) {
+            for (auto& waiter : _flush_waiters) {
+                waiters.push_back(std::move(waiter));
+            }
+            _flush_waiters.clear();
+        } else if (!_flush_waiters.empty() || _pending_size >= _flush_size) {
+            send_batch();
+        }
+
+        for (auto& waiter : waiters) {
+            waiter.set_value(result);
+        }
+    });
+}
+
+InputStream::InputStream(ConnectedSocket &socket) :
+    _socket(socket)
+{
+}
+
+BPromise::Future<TemporaryBuffer> InputStream::read_exactly(size_t size)
+{
+    if (_buffer.size() >= size || _eof) {
+        return BPromise::make_ready_future<TemporaryBuffer>(take(std::min(size, _buffer.size())));
+    }
+
+    // the next read may well hold all of it
+    if (_buffer.empty()) {
+        return fill().then([this, size](bool) {
+            return read_exactly(size);
+        });
+    }
+
+    // spanning reads: collected in one buffer of the full size
+    TemporaryBuffer result(size);
+    auto filled = _buffer.size();
+    std::memcpy(result.get_write(), _buffer.get(), filled);
+    _buffer = TemporaryBuffer();
+
+    return read_into(std::move(result), filled);
+}
+
+BPromise::Future<TemporaryBuffer> InputStream::read_until(std::string_view delimiter)
+{
+    if (delimiter.empty()) {
+        return BPromise::make_ready_future<TemporaryBuffer>(TemporaryBuffer());
+    }
+
+    return scan_until(std::string(delimiter), 0);
+}
+
+BPromise::Future<TemporaryBuffer> InputStream::scan_until(std::string delimiter, size_t scanned)
+{
+    auto pos = find(_buffer.view(), delimiter, scanned);
+    if (pos != npos) {
+        return BPromise::make_ready_future<TemporaryBuffer>(take(pos + delimiter.size()));
+    }
+
+    if (_eof) {
+        return BPromise::make_ready_future<TemporaryBuffer>(take(_buffer.size()));
+    }
+
+    // a delimiter may start within the last bytes and continue in the next read
+    auto tail = delimiter.size() - 1;
+    scanned = _buffer.size() > tail ? _buffer.size() - tail : 0;
+
+    return fill().then([this, delimiter = std::move(delimiter), scanned](bool) mutable {
+        return scan_until(std::move(delimiter), scanned);
+    });
+}
+
+BPromise::Future<TemporaryBuffer> InputStream::read_some()
+{
+    if (!_buffer.empty() || _eof) {
+        return BPromise::make_ready_future<TemporaryBuffer>(take(_buffer.size()));
+    }
+
+    return fill().then([this](bool) {
+        return BPromise::make_ready_future<TemporaryBuffer>(take(_buffer.size()));
+    });
+}
+
+// memchr is vectorized by the C library; candidates are then compared in full
+size_t InputStream::find(std::string_view data, std::string_view delimiter, size_t from)
+{
+    if (delimiter.empty()) {
+        return from <= data.size() ? from : npos;
+    }
+
+    while (from + delimiter.size() <= data.size()) {
+        auto hit = std::memchr(data.data() + from, delimiter[0], data.size() - from - delimiter.size() + 1);
+        if (!hit) {
+            return npos;
+        }
+
+        auto pos = static_cast<size_t>(static_cast<const char*>(hit) - data.data());
+        if (std::memcmp(data.data() + pos + 1, delimiter.data() + 1, delimiter.size() - 1) == 0) {
+            return pos;
+        }
+        from = pos + 1;
+    }
+
+    return npos;
+}
+
+BPromise::Future<bool> InputStream::fill()
+{
+    if (_eof) {
+        return BPromise::make_ready_future<bool>(false);
+    }
+
+    return _socket.read_buffer().then([this](int result, TemporaryBuffer data) {
+        if (result <= 0) {
+            end(result);
+            return false;
+        }
+
+        if (_buffer.empty()) {
+            _buffer = std::move(data);
+            _spare = nullptr;
+        } else {
+            append(data);
+        }
+        return true;
+    });
+}
+
+void InputStream::append(const TemporaryBuffer &data)
+{
+    auto size = _buffer.size() + data.size();
+    if (_buffer.get() + _buffer.size() == _spare && data.size() <= _spare_size) {
+        std::memcpy(_spare, data.get(), data.size());
+        _buffer = _buffer.share(0, size);
+        _spare += data.size();
+        _spare_size -= data.size();
+        return;
+    }
+
+    // twice the room needed: a scan spanning many reads copies each byte a
+    // bounded number of times instead of once per read
+    TemporaryBuffer block(size * 2);
+    std::memcpy(block.get_write(), _buffer.get(), _buffer.size());
+    std::memcpy(block.get_write() + _buffer.size(), data.get(), data.size());
+    _buffer = block.share(0, size);
+    _spare = block.get_write() + size;
+    _spare_size = size;
+}
+
+BPromise::Future<TemporaryBuffer> InputStream::read_into(TemporaryBuffer result, size_t filled)
+{
+    return _socket.read_buffer().then([this, result = std::move(result), filled](int size, TemporaryBuffer data) mutable {
+        if (size <= 0) {
+            end(size);
+            result.trim(filled);
+            return BPromise::make_ready_future<TemporaryBuffer>(std::move(result));
+        }
+
+        auto used = std::min(data.size(), result.size() - filled);
+        std::memcpy(result.get_write() + filled, data.get(), used);
+        filled += used;
+        if (filled < result.size()) {
+            return read_into(std::move(result), filled);
+        }
+
+        data.trim_front(used);
+        _buffer = std::move(data);
+        _spare = nullptr;
+        return BPromise::make_ready_future<TemporaryBuffer>(std::move(result));
+    });
+}
+
+TemporaryBuffer InputStream::take(size_t size)
+{
+    if (size == _buffer.size()) {
+        return std::move(_buffer);
+    }
+
+    auto data = _buffer.share(0, size);
+    _buffer.trim_front(size);
+    return data;
+}
+
+void InputStream::end(int result)
+{
+    _eof = true;
+    _failed = result < 0;
+}
+
+}
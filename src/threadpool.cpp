@@ -6,6 +6,161 @@ namespace BPromise
 Scheduler MainThread::_scheduler;
 
 std::vector<std::unique_ptr<ThreadPool::Thread>> ThreadPool::_threads;
-size_t ThreadPool::_current_thread = 0;
+std::atomic<size_t> ThreadPool::_next{0};
+std::atomic<size_t> ThreadPool::_idle{0};
+thread_local ThreadPool::Backlog ThreadPool::_backlog;
 
-}
\ No newline at end of file
+void ThreadPool::start(size_t count, IoBackend backend)
+{
+    for (size_t n = 0; n < count; ++n) {
+        _threads.emplace_back(std::make_unique<Thread>(backend));
+    }
+
+    // threads only start looking at each other once all of them exist
+    for (size_t n = 0; n < _threads.size(); ++n) {
+        auto thread = _threads[n].get();
+        thread->scheduler.set_work_source([thread]() { return thread->work(); });
+        thread->thread = std::thread([thread, n]() {
+            BPROMISE_TRACE_THREAD("pool-" + std::to_string(n));
+            _local = thread;
+            thread->scheduler.run();
+            _local = nullptr;
+        });
+    }
+}
+
+void ThreadPool::stop()
+{
+    for (auto& t : _threads) {
+        t->scheduler.stop();
+    }
+
+    for (auto& t : _threads) {
+        t->thread.join();
+    }
+
+    _threads.clear();
+    _idle = 0;
+}
+
+std::vector<WorkerMetrics> ThreadPool::metrics()
+{
+    std::vector<WorkerMetrics> metrics;
+    for (auto& thread : _threads) {
+        metrics.push_back(thread->scheduler.metrics());
+    }
+    return metrics;
+}
+
+// Wakes one sleeping thread so it can steal from `self`
+void ThreadPool::wake_idle(Thread *self)
+{
+    // pairs with the rescan in Thread::work(): either this load sees the thread
+    // going idle, or its rescan sees the task just pushed
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_idle.load() == 0) {
+        return;
+    }
+
+    auto count = _threads.size();
+    auto start = self->random % count;
+    for (size_t n = 0; n < count; ++n) {
+        auto thread = _threads[(start + n) % count].get();
+        if (thread != self && thread->idle.load(std::memory_order_relaxed) && thread->idle.exchange(false)) {
+            _idle.fetch_sub(1);
+            thread->scheduler.reactor().wake();
+            return;
+        }
+    }
+}
+
+ThreadPool::Thread::Thread(IoBackend backend) :
+    random(reinterpret_cast<uintptr_t>(this) | 1)
+{
+    scheduler.reactor().set_backend(backend);
+}
+
+ThreadPool::Thread::~Thread()
+{
+    while (auto task = deque.pop()) {
+        scheduler.free_task(task);
+    }
+}
+
+bool ThreadPool::Thread::work()
+{
+    size_t n = 0;
+    for (; n < work_batch; ++n) {
+        auto task = deque.pop();
+        if (!task) {
+            task = steal();
+        }
+        if (!task) {
+            break;
+        }
+
+        scheduler.execute(task, scheduler._pool_tasks);
+        scheduler.free_task(task);
+    }
+
+    if (n == 0) {
+        if (!idle.load(std::memory_order_relaxed) && !idle.exchange(true)) {
+            _idle.fetch_add(1);
+        }
+
+        // a task pushed while this thread was not counted idle yet woke nobody
+        if (auto task = steal()) {
+            if (idle.exchange(false)) {
+                _idle.fetch_sub(1);
+            }
+            scheduler.execute(task, scheduler._pool_tasks);
+            scheduler.free_task(task);
+            return true;
+        }
+    } else if (idle.load(std::memory_order_relaxed) && idle.exchange(false)) {
+        _idle.fetch_sub(1);
+    }
+
+    return n > 0;
+}
+
+// Tries every other thread once, starting from a random one
+TaskCallback* ThreadPool::Thread::steal()
+{
+    auto count = _threads.size();
+    if (count < 2) {
+        return nullptr;
+    }
+
+    // xorshift64
+    random ^= random << 13;
+    random ^= random >> 7;
+    random ^= random << 17;
+
+    auto start = random % count;
+    for (size_t n = 0; n < count; ++n) {
+        auto victim = _threads[(start + n) % count].get();
+        if (victim == this) {
+            continue;
+        }
+        if (auto task = victim->deque.steal()) {
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+void ThreadPool::release(Backlog *backlog)
+{
+    if (backlog->waiting.empty()) {
+        --backlog->running;
+        return;
+    }
+
+    // the slot passes straight to the oldest waiting task
+    auto next = std::move(backlog->waiting.front());
+    backlog->waiting.pop_front();
+    next();
+}
+
+}
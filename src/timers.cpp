@@ -0,0 +1,87 @@
+#include "bpromise/timers.h"
+
+namespace BPromise
+{
+
+void TimerHeap::push(TimerNode *node, TimePoint deadline)
+{
+    node->_deadline = deadline;
+    node->_sequence = _sequence++;
+
+    _nodes.push_back(node);
+    node->_heap_index = _nodes.size() - 1;
+    sift_up(node->_heap_index);
+}
+
+void TimerHeap::remove(TimerNode *node)
+{
+    if (!node->armed()) {
+        return;
+    }
+
+    auto index = node->_heap_index;
+    auto last = _nodes.back();
+    _nodes.pop_back();
+    node->_heap_index = TimerNode::npos;
+
+    if (last != node) {
+        place(index, last);
+        if (index > 0 && less(last, _nodes[(index - 1) / arity])) {
+            sift_up(index);
+        } else {
+            sift_down(index);
+        }
+    }
+}
+
+TimerNode* TimerHeap::pop()
+{
+    auto node = top();
+    if (node) {
+        remove(node);
+    }
+    return node;
+}
+
+void TimerHeap::sift_up(size_t index)
+{
+    auto node = _nodes[index];
+    while (index > 0) {
+        auto parent = (index - 1) / arity;
+        if (!less(node, _nodes[parent])) {
+            break;
+        }
+        place(index, _nodes[parent]);
+        index = parent;
+    }
+    place(index, node);
+}
+
+void TimerHeap::sift_down(size_t index)
+{
+    auto node = _nodes[index];
+    auto size = _nodes.size();
+    while (true) {
+        auto first = index * arity + 1;
+        if (first >= size) {
+            break;
+        }
+
+        auto best = first;
+        auto end = first + arity < size ? first + arity : size;
+        for (auto child = first + 1; child < end; ++child) {
+            if (less(_nodes[child], _nodes[best])) {
+                best = child;
+            }
+        }
+
+        if (!less(_nodes[best], node)) {
+            break;
+        }
+        place(index, _nodes[best]);
+        index = best;
+    }
+    place(index, node);
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,184 @@
+#include "bpromise/trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace BPromise
+{
+
+namespace
+{
+
+struct TraceEvent
+{
+    const char *category;
+    const char *name;
+    uint64_t ts; // ns of steady_clock
+    uint64_t arg; // flow id, or code address of a slice
+    char phase;
+};
+
+struct ThreadBuffer
+{
+    std::vector<TraceEvent> events;
+    std::atomic<uint64_t> head{0}; // events ever written
+    std::string name;
+    size_t tid = 0;
+};
+
+// Buffers outlive their threads, so a dump still has the pool's events after stop()
+std::mutex buffers_lock;
+std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+std::atomic<uint64_t> last_flow{0};
+
+thread_local ThreadBuffer *local = nullptr;
+thread_local std::string local_name;
+
+// Allocated on the first event, threads that never trace cost nothing
+ThreadBuffer& local_buffer()
+{
+    if (!local) {
+        auto buffer = std::make_unique<ThreadBuffer>();
+        buffer->events.resize(Tracer::ring_size);
+        buffer->name = local_name;
+
+        std::scoped_lock lock(buffers_lock);
+        buffer->tid = buffers.size() + 1;
+        local = buffer.get();
+        buffers.push_back(std::move(buffer));
+    }
+    return *local;
+}
+
+void record(const char *category, const char *name, char phase, uint64_t arg)
+{
+    auto& buffer = local_buffer();
+    auto head = buffer.head.load(std::memory_order_relaxed);
+    auto ts = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    buffer.events[head % Tracer::ring_size] = TraceEvent{category, name, static_cast<uint64_t>(ts), arg, phase};
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+void append_escaped(std::string &out, const std::string &text)
+{
+    for (auto c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        if (static_cast<unsigned char>(c) >= 0x20) {
+            out += c;
+        }
+    }
+}
+
+}
+
+void Tracer::begin(const char *category, const char *name, const void *code)
+{
+    record(category, name, 'B', reinterpret_cast<uintptr_t>(code));
+}
+
+void Tracer::end(const char *category, const char *name)
+{
+    record(category, name, 'E', 0);
+}
+
+void Tracer::instant(const char *category, const char *name)
+{
+    record(category, name, 'i', 0);
+}
+
+uint64_t Tracer::flow_start(const char *category, const char *name)
+{
+    auto id = last_flow.fetch_add(1, std::memory_order_relaxed) + 1;
+    record(category, name, 's', id);
+    return id;
+}
+
+void Tracer::flow_end(const char *category, const char *name, uint64_t id)
+{
+    record(category, name, 'f', id);
+}
+
+void Tracer::set_thread_name(std::string name)
+{
+    if (local) {
+        std::scoped_lock lock(buffers_lock);
+        local->name = name;
+    }
+    local_name = std::move(name);
+}
+
+std::string Tracer::chrome_json()
+{
+    std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    char line[512];
+    bool first = true;
+    auto separate = [&out, &first]() {
+        if (!first) {
+            out += ",\n";
+        }
+        first = false;
+    };
+
+    std::scoped_lock lock(buffers_lock);
+    for (auto& buffer : buffers) {
+        if (!buffer->name.empty()) {
+            separate();
+            std::snprintf(line, sizeof(line), "{\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"name\":\"thread_name\",\"args\":{\"name\":\"", buffer->tid);
+            out += line;
+            append_escaped(out, buffer->name);
+            out += "\"}}";
+        }
+
+        auto head = buffer->head.load(std::memory_order_acquire);
+        auto begin = head > ring_size ? head - ring_size : 0;
+        for (auto n = begin; n < head; ++n) {
+            auto& event = buffer->events[n % ring_size];
+            separate();
+            auto size = std::snprintf(line, sizeof(line), "{\"ph\":\"%c\",\"cat\":\"%s\",\"name\":\"%s\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f",
+                event.phase, event.category, event.name, buffer->tid, static_cast<double>(event.ts) / 1000);
+            out.append(line, std::min<size_t>(size, sizeof(line) - 1));
+
+            if (event.phase == 's' || event.phase == 'f') {
+                std::snprintf(line, sizeof(line), ",\"id\":%llu%s}", static_cast<unsigned long long>(event.arg),
+                    event.phase == 'f' ? ",\"bp\":\"e\"" : "");
+            } else if (event.phase == 'i') {
+                std::snprintf(line, sizeof(line), ",\"s\":\"t\"}");
+            } else if (event.phase == 'B' && event.arg) {
+                std::snprintf(line, sizeof(line), ",\"args\":{\"code\":\"0x%llx\"}}", static_cast<unsigned long long>(event.arg));
+            } else {
+                std::snprintf(line, sizeof(line), "}");
+            }
+            out += line;
+        }
+    }
+
+    out += "]}\n";
+    return out;
+}
+
+bool Tracer::write(const std::string &path)
+{
+    auto file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        return false;
+    }
+
+    auto json = chrome_json();
+    bool written = std::fwrite(json.data(), 1, json.size(), file) == json.size();
+    return std::fclose(file) == 0 && written;
+}
+
+void Tracer::clear()
+{
+    std::scoped_lock lock(buffers_lock);
+    for (auto& buffer : buffers) {
+        buffer->head.store(0);
+    }
+}
+
+}
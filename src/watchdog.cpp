@@ -0,0 +1,308 @@
+#include "bpromise/watchdog.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+
+#if defined(__linux__) && __has_include(<execinfo.h>)
+#   define HAS_BACKTRACE
+#   include <execinfo.h>
+#   include <signal.h>
+#   include <sys/syscall.h>
+#   include <unistd.h>
+#   include <cerrno>
+#   include <cstdint>
+#   include <cstdlib>
+#endif
+
+namespace BPromise
+{
+
+StallDetector::Options StallDetector::_options;
+std::vector<StallDetector::Watched> StallDetector::_watched;
+TimePoint StallDetector::_next_report;
+size_t StallDetector::_suppressed = 0;
+bool StallDetector::_running = false;
+std::mutex StallDetector::_lock;
+std::condition_variable StallDetector::_wake;
+std::thread StallDetector::_thread;
+
+#if defined(HAS_BACKTRACE)
+
+namespace
+{
+
+// One capture at a time, requested by the watchdog thread and filled in by
+// the signal handler on the stalled thread. Requests are numbered and each
+// signal carries its number: a late signal, for a request the watchdog gave
+// up on, must not answer the next one with another thread's frames.
+struct Capture
+{
+    static constexpr int max_frames = 64;
+
+    std::atomic<uint64_t> pending{0}; // request to answer, 0 once claimed or given up
+    std::atomic<uint64_t> done{0};    // last request answered
+    void *frames[max_frames];
+    int size = 0;
+};
+
+Capture capture;
+uint64_t last_request = 0; // watchdog thread only
+struct sigaction previous_action;
+
+void on_capture_signal(int, siginfo_t *info, void*)
+{
+    auto request = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(info->si_value.sival_ptr));
+    auto expected = request;
+    if (request == 0 || !capture.pending.compare_exchange_strong(expected, 0)) {
+        return;
+    }
+
+    auto saved = errno;
+    capture.size = ::backtrace(capture.frames, Capture::max_frames);
+    errno = saved;
+    capture.done.store(request, std::memory_order_release);
+}
+
+}
+
+std::vector<void*> StallDetector::capture_backtrace(int thread_id)
+{
+    static constexpr auto delivery_timeout = std::chrono::milliseconds(50);
+
+    if (thread_id == 0) {
+        return {};
+    }
+
+    auto request = ++last_request;
+    capture.pending.store(request);
+
+    // tgkill() with a payload: the request's number
+    siginfo_t info = {};
+    info.si_signo = SIGRTMIN;
+    info.si_code = SI_QUEUE;
+    info.si_pid = ::getpid();
+    info.si_uid = ::getuid();
+    info.si_value.sival_ptr = reinterpret_cast<void*>(static_cast<uintptr_t>(request));
+    if (::syscall(SYS_rt_tgsigqueueinfo, ::getpid(), thread_id, SIGRTMIN, &info) != 0) {
+        capture.pending.store(0);
+        return {};
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + delivery_timeout;
+    while (capture.done.load(std::memory_order_acquire) != request) {
+        // once the handler claimed the request it finishes it, so wait on
+        auto expected = request;
+        if (std::chrono::steady_clock::now() > deadline && capture.pending.compare_exchange_strong(expected, 0)) {
+            return {}; // signal blocked, or the thread is gone
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+    return std::vector<void*>(capture.frames, capture.frames + capture.size);
+}
+
+std::string format_stall(const StallReport &report)
+{
+    char line[256];
+    std::snprintf(line, sizeof(line), "bpromise: worker %s stalled for %lld ms", report.worker.c_str(),
+        static_cast<long long>(report.duration.count()));
+    std::string out = line;
+
+    if (report.suppressed > 0) {
+        std::snprintf(line, sizeof(line), " (%zu earlier reports suppressed)", report.suppressed);
+        out += line;
+    }
+    out += "\n";
+    if (!report.task) {
+        out += "  outside of tasks\n";
+    }
+
+    std::vector<void*> addresses;
+    if (report.task) {
+        addresses.push_back(const_cast<void*>(report.task));
+    }
+    addresses.insert(addresses.end(), report.backtrace.begin(), report.backtrace.end());
+    if (addresses.empty()) {
+        return out;
+    }
+
+    auto symbols = ::backtrace_symbols(addresses.data(), static_cast<int>(addresses.size()));
+    for (size_t n = 0; n < addresses.size(); ++n) {
+        const char *prefix = report.task && n == 0 ? "  task " : "  #";
+        if (symbols) {
+            std::snprintf(line, sizeof(line), "%s%s\n", prefix, symbols[n]);
+        } else {
+            std::snprintf(line, sizeof(line), "%s%p\n", prefix, addresses[n]);
+        }
+        out += line;
+    }
+    std::free(symbols);
+    return out;
+}
+
+#else
+
+std::vector<void*> StallDetector::capture_backtrace(int)
+{
+    return {};
+}
+
+std::string format_stall(const StallReport &report)
+{
+    char line[256];
+    std::snprintf(line, sizeof(line), "bpromise: worker %s stalled for %lld ms, %zu earlier reports suppressed\n  task %p\n",
+        report.worker.c_str(), static_cast<long long>(report.duration.count()), report.suppressed, report.task);
+    return line;
+}
+
+#endif
+
+void StallDetector::start(Options options)
+{
+    std::scoped_lock lock(_lock);
+    if (_running) {
+        return;
+    }
+
+    _options = std::move(options);
+    if (!_options.report) {
+        _options.report = [](const StallReport &report) {
+            std::fputs(format_stall(report).c_str(), stderr);
+        };
+    }
+
+#if defined(HAS_BACKTRACE)
+    if (_options.backtrace) {
+        // the first backtrace() loads libgcc, which is not safe in a signal handler
+        void *warmup[1];
+        ::backtrace(warmup, 1);
+
+        struct sigaction action = {};
+        action.sa_sigaction = on_capture_signal;
+        action.sa_flags = SA_RESTART | SA_SIGINFO;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGRTMIN, &action, &previous_action);
+    }
+#endif
+
+    _next_report = TimePoint();
+    _suppressed = 0;
+    _running = true;
+    _thread = std::thread(run);
+}
+
+void StallDetector::stop()
+{
+    {
+        std::scoped_lock lock(_lock);
+        if (!_running) {
+            return;
+        }
+        _running = false;
+    }
+
+    _wake.notify_all();
+    _thread.join();
+
+#if defined(HAS_BACKTRACE)
+    if (_options.backtrace) {
+        sigaction(SIGRTMIN, &previous_action, nullptr);
+    }
+#endif
+    _options.report = nullptr;
+}
+
+void StallDetector::watch(Worker &worker, std::string name)
+{
+    std::scoped_lock lock(_lock);
+    Watched watched;
+    watched.worker = &worker;
+    watched.name = std::move(name);
+    _watched.push_back(std::move(watched));
+}
+
+void StallDetector::unwatch(Worker &worker)
+{
+    std::scoped_lock lock(_lock);
+    _watched.erase(std::remove_if(_watched.begin(), _watched.end(), [&worker](const Watched &watched) {
+        return watched.worker == &worker;
+    }), _watched.end());
+}
+
+void StallDetector::run()
+{
+    std::vector<StallReport> reports;
+    std::vector<int> threads; // of the reports' workers, to take their backtraces
+    std::unique_lock lock(_lock);
+
+    while (_running) {
+        auto period = std::max(_options.threshold / 4, std::chrono::milliseconds(1));
+        _wake.wait_for(lock, period);
+        if (!_running) {
+            break;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        for (auto& watched : _watched) {
+            check(watched, now, reports, threads);
+        }
+
+        // a backtrace may take up to its delivery timeout, and the reporter may
+        // watch or unwatch: neither holds up the workers calling those
+        if (!reports.empty()) {
+            lock.unlock();
+            for (size_t n = 0; n < reports.size(); ++n) {
+                if (_options.backtrace) {
+                    reports[n].backtrace = capture_backtrace(threads[n]);
+                }
+                _options.report(reports[n]);
+            }
+            reports.clear();
+            threads.clear();
+            lock.lock();
+        }
+    }
+}
+
+void StallDetector::check(Watched &watched, TimePoint now, std::vector<StallReport> &reports, std::vector<int> &threads)
+{
+    auto& worker = *watched.worker;
+    auto progress = worker._iterations.load(std::memory_order_relaxed)
+        + worker._immediate_tasks.load(std::memory_order_relaxed)
+        + worker._timer_tasks.load(std::memory_order_relaxed)
+        + worker._pool_tasks.load(std::memory_order_relaxed);
+    auto task = worker._executing.load(std::memory_order_relaxed);
+    bool idle = !worker._running.load() || (worker._sleeping.load() && !task);
+
+    if (idle || progress != watched.progress || task != watched.task || watched.since == TimePoint()) {
+        watched.progress = progress;
+        watched.task = task;
+        watched.since = now;
+        watched.next_report = _options.threshold;
+        return;
+    }
+
+    // `since` is when the stall was first seen, so durations are lower bounds
+    auto duration = now - watched.since;
+    if (duration < watched.next_report) {
+        return;
+    }
+    watched.next_report *= 2;
+
+    if (now < _next_report) {
+        ++_suppressed;
+        return;
+    }
+    _next_report = now + _options.report_interval;
+
+    StallReport report;
+    report.worker = watched.name;
+    report.duration = std::chrono::duration_cast<std::chrono::milliseconds>(duration);
+    report.task = task;
+    report.suppressed = _suppressed;
+    _suppressed = 0;
+    reports.push_back(std::move(report));
+    threads.push_back(worker._thread_id.load());
+}
+
+}
@@ -1,108 +1,322 @@
 #include "bpromise/worker.h"
 #include <algorithm>
 
+#if defined(__linux__)
+#   include <sys/syscall.h>
+#   include <unistd.h>
+#endif
+
 namespace BPromise
 {
 
-void WaitEvent::signal()
+Worker::~Worker()
 {
-    {
-        std::scoped_lock lock(_waitlock);
-        _stopwait = true;
+    if (_wait_for_finish) {
+        stop();
+        _finish_wait.wait();
     }
-    _wait.notify_all();
-}
 
-void WaitEvent::wait()
-{
-    std::unique_lock lock(_waitlock);
-    _wait.wait(lock, [this]() { return _stopwait; });
-    _stopwait = false;
+    // io_uring requests still in flight own sockets and files being closed
+    _reactor.drain();
+
+    while (auto task = _immediate.pop()) {
+        free_task(static_cast<TaskCallback*>(task));
+    }
+
+    while (auto task = _timers.pop()) {
+        free_task(static_cast<TaskCallback*>(task));
+    }
 }
 
-void WaitEvent::wait_until(TimePoint time)
+size_t Worker::count()
 {
-    std::unique_lock lock(_waitlock);
-    _wait.wait_until(lock, time, [this]() { return _stopwait; });
-    _stopwait = false;
+    std::scoped_lock lock(_lock);
+    return _immediate_count.load(std::memory_order_relaxed) + _timers.size() + (_current ? 1 : 0);
 }
 
-
-Worker::~Worker()
+TaskAllocationStats Worker::allocation_stats() const
 {
-    if (_wait_for_finish) {
-        stop();
-        _finish_wait.wait();
-    }
+    TaskAllocationStats stats;
+    stats.pooled = _pooled.load(std::memory_order_relaxed);
+    stats.allocated = _allocated.load(std::memory_order_relaxed);
+    stats.oversized = _oversized.load(std::memory_order_relaxed);
+    return stats;
 }
 
-size_t Worker::count()
+WorkerMetrics Worker::metrics()
 {
-    std::scoped_lock lock(_lock);
-    return _tasks.size();
+    WorkerMetrics metrics;
+    metrics.immediate_tasks = _immediate_tasks.load(std::memory_order_relaxed);
+    metrics.timer_tasks = _timer_tasks.load(std::memory_order_relaxed);
+    metrics.pool_tasks = _pool_tasks.load(std::memory_order_relaxed);
+    metrics.immediate_depth = _immediate_count.load(std::memory_order_relaxed);
+    metrics.wakeups = _wakeups.load(std::memory_order_relaxed);
+    metrics.busy = std::chrono::nanoseconds(_busy_ns.load(std::memory_order_relaxed));
+    metrics.idle = std::chrono::nanoseconds(_idle_ns.load(std::memory_order_relaxed));
+    metrics.delay = _delay.snapshot();
+    metrics.run_time = _run_time.snapshot();
+    {
+        std::scoped_lock lock(_lock);
+        metrics.timer_depth = _timers.size();
+    }
+    return metrics;
 }
 
 void Worker::run()
 {
+    auto previous = _thread_worker;
+    auto previous_arena = Arena::_current;
+    _thread_worker = this;
+    Arena::_current = &_arena;
     _running = true;
     _wait_for_finish = true;
+#if defined(__linux__)
+    _thread_id.store(static_cast<int>(::syscall(SYS_gettid)));
+#endif
+
+    // busy time is accounted once per iteration, idle time around blocking waits
+    auto mark = std::chrono::steady_clock::now();
 
     while (_running) {
-        std::shared_ptr<TaskCallback> task;
-        {
-            std::scoped_lock lock(_lock);
+        add(_iterations, 1);
+        run_immediate();
+        auto deadline = run_timers();
+
+        if (_work_source && _work_source()) {
+            deadline = TimePoint::min();
+        }
 
-            auto f = min_element(
-                _tasks.begin(), _tasks.end(),
-                [](auto &a, auto &b) { return a->schedule() < b->schedule(); }
-            );
+        if (!_immediate.empty()) {
+            deadline = TimePoint::min();
+        }
 
-            if (f != _tasks.end()) {
-                task = *f;
+        // poll for I/O even when busy, so sockets are not starved by immediate work
+        if (deadline != TimePoint::min() || _reactor.size() > 0) {
+            _sleeping.store(true);
+            if (!_immediate.empty() || _timers_changed.load() || !_running) {
+                deadline = TimePoint::min();
             }
+
+            auto now = std::chrono::steady_clock::now();
+            add(_busy_ns, std::chrono::duration_cast<std::chrono::nanoseconds>(now - mark).count());
+            mark = now;
+
+            _reactor.wait(deadline);
+            _sleeping.store(false);
+
+            if (deadline != TimePoint::min()) {
+                now = std::chrono::steady_clock::now();
+                add(_idle_ns, std::chrono::duration_cast<std::chrono::nanoseconds>(now - mark).count());
+                add(_wakeups, 1);
+                mark = now;
+            }
+
+            _reactor.dispatch();
         }
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    add(_busy_ns, std::chrono::duration_cast<std::chrono::nanoseconds>(now - mark).count());
+
+    _thread_id.store(0);
+    _thread_worker = previous;
+    Arena::_current = previous_arena;
+    _finish_wait.signal();
+}
 
+void Worker::run_immediate()
+{
+    for (size_t n = 0; n < immediate_batch; ++n) {
+        auto task = static_cast<TaskCallback*>(_immediate.pop());
         if (!task) {
-            _wait.wait();
+            break;
+        }
+
+        // tasks timestamped by set_immediate() are the sampled ones
+        _executing.store(task->code(), std::memory_order_relaxed);
+        if (task->_enqueued == TimePoint()) {
+            task->execute();
         } else {
-            _wait.wait_until(task->schedule());
+            auto start = std::chrono::steady_clock::now();
+            _delay.record(start - task->_enqueued);
+            task->execute();
+            _run_time.record(std::chrono::steady_clock::now() - start);
+        }
+        _executing.store(nullptr, std::memory_order_relaxed);
 
-            auto now = std::chrono::steady_clock::now();
-            if (now >= task->schedule()) {
-                task->execute();
+        add(_immediate_tasks, 1);
+        free_task(task);
+        _immediate_count.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+// Runs expired timers, returns the deadline of the next pending one
+TimePoint Worker::run_timers()
+{
+    TimePoint now;
+
+    for (size_t n = 0; n < immediate_batch; ++n) {
+        TaskCallback *task = nullptr;
+        {
+            std::scoped_lock lock(_lock);
+            _timers_changed.store(false, std::memory_order_relaxed);
+
+            auto top = _timers.top();
+            if (!top) {
+                return TimePoint::max();
+            }
 
-                if (task->type() == TaskType::Periodic) {
-                    task->reschedule(now);
-                } else {
-                    cancel_task(task);
+            if (now < top->deadline()) {
+                now = std::chrono::steady_clock::now();
+                if (now < top->deadline()) {
+                    return top->deadline();
                 }
             }
+
+            task = static_cast<TaskCallback*>(_timers.pop());
+            _current = task;
+            _current_cleared = false;
         }
+
+        // `now` may be a little behind for the later timers of a batch
+        _delay.record(now - task->deadline());
+        execute(task, _timer_tasks);
+
+        {
+            std::scoped_lock lock(_lock);
+            _current = nullptr;
+            if (task->type() == TaskType::Periodic && !_current_cleared) {
+                _timers.push(task, now + task->interval());
+                continue;
+            }
+            _cancellable.erase(task->id());
+        }
+
+        // callable destructors may schedule new work, so free outside of the lock
+        free_task(task);
     }
 
-    _finish_wait.signal();
+    return now;
 }
 
 void Worker::stop()
 {
     _running = false;
-    _wait.signal();
+    _reactor.wake();
 }
 
-void Worker::cancel_task(const std::shared_ptr<TaskCallback> &task)
+bool Worker::clear_timer(TimerId id)
 {
-    std::scoped_lock lock(_lock);
-    auto f = find(_tasks.begin(), _tasks.end(), task);
-    if (f != _tasks.end()) {
-        _tasks.erase(f);
+    TaskCallback *task = nullptr;
+    {
+        std::scoped_lock lock(_lock);
+        auto f = _cancellable.find(id);
+        if (f == _cancellable.end()) {
+            return false;
+        }
+
+        task = f->second;
+        if (task == _current) {
+            // cleared from inside its own callback, run() releases it afterwards
+            if (_current_cleared || task->type() == TaskType::Oneshot) {
+                return false;
+            }
+            _current_cleared = true;
+            return true;
+        }
+
+        _timers.remove(task);
+        _cancellable.erase(f);
+    }
+
+    free_task(task);
+    return true;
+}
+
+void Worker::execute(TaskCallback *task, std::atomic<uint64_t> &counter)
+{
+    add(counter, 1);
+    _executing.store(task->code(), std::memory_order_relaxed);
+
+    if (!sampled()) {
+        task->execute();
+    } else {
+        auto start = std::chrono::steady_clock::now();
+        task->execute();
+        _run_time.record(std::chrono::steady_clock::now() - start);
+    }
+
+    _executing.store(nullptr, std::memory_order_relaxed);
+}
+
+void Worker::HistogramCounters::record(std::chrono::steady_clock::duration duration)
+{
+    auto ns = static_cast<uint64_t>(std::max<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(), 0));
+
+    size_t index = 0;
+    while (index + 1 < LatencyHistogram::bucket_count && (uint64_t(1) << index) <= ns) {
+        ++index;
+    }
+
+    add(buckets[index], 1);
+    add(count, 1);
+    add(sum_ns, ns);
+}
+
+LatencyHistogram Worker::HistogramCounters::snapshot() const
+{
+    LatencyHistogram histogram;
+    for (size_t n = 0; n < LatencyHistogram::bucket_count; ++n) {
+        histogram.buckets[n] = buckets[n].load(std::memory_order_relaxed);
+    }
+    histogram.count = count.load(std::memory_order_relaxed);
+    histogram.sum_ns = sum_ns.load(std::memory_order_relaxed);
+    return histogram;
+}
+
+uint64_t LatencyHistogram::quantile(double q) const
+{
+    // the buckets may be read a little apart from count, so sum them up
+    uint64_t total = 0;
+    for (auto bucket : buckets) {
+        total += bucket;
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    auto rank = static_cast<uint64_t>(q * (total - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t n = 0; n < bucket_count; ++n) {
+        seen += buckets[n];
+        if (seen >= rank) {
+            return uint64_t(1) << n;
+        }
+    }
+    return uint64_t(1) << (bucket_count - 1);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+    for (size_t n = 0; n < bucket_count; ++n) {
+        buckets[n] += other.buckets[n];
+    }
+    count += other.count;
+    sum_ns += other.sum_ns;
+}
+
+void Worker::free_task(TaskCallback *task)
+{
+    task->~TaskCallback();
+    if (_thread_worker != this || !_pool.release(task)) {
+        ::operator delete(task);
     }
 }
 
-void TaskCallback::execute()
+TaskPool::~TaskPool()
 {
-    _callback();
-    if (_type == TaskType::Oneshot) {
-        _wait.signal();
+    while (auto block = allocate()) {
+        ::operator delete(block);
     }
 }
 